@@ -36,6 +36,8 @@ void adc_init (void)
 
 uint16_t ui16_adc_read_battery_voltage_10b (void)
 {
+  // EOC stays set after the previous conversion, clear it so the wait is for this conversion
+  ADC1_ClearFlag (ADC1_FLAG_EOC);
   ADC1_StartConversion ();
   while (!ADC1_GetFlagStatus(ADC1_FLAG_EOC)) ;
 
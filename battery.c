@@ -0,0 +1,235 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "stm8s_tim3.h"
+#include "main.h"
+#include "config.h"
+#include "battery.h"
+#include "filter.h"
+
+// Energy integrator
+//
+// Each received package adds ADC battery voltage * battery current x5 * elapsed TIM3 ticks, which is energy
+// in units of: 0.0863 V (ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000) * 0.2 A * 1.024 ms (16MHz / 16384) = 17.674 uJ
+// and 0.1 Wh = 360 J = 360 / 17.674e-6 = 20368627 units.
+//
+// The integrator is a 0.1 Wh counter plus the remainder in energy units, which is the same as a 64 bits
+// accumulator: every unit is kept on the remainder so there is no truncation loss, and the remainder is always
+// lower than ENERGY_UNITS_PER_WH_X10 + max increment (~151M), so it never overflows.
+#define ENERGY_UNITS_PER_WH_X10   20368627
+
+// limit the elapsed time between packages to 0.5 seconds, so a communication loss will not integrate
+// the last power/current value for all the time without communications
+#define BATTERY_MAX_DELTA_TIME    488
+
+static uint32_t ui32_energy_wh_x10 = 0;
+static uint32_t ui32_energy_remainder = 0;
+
+static uint16_t ui16_last_update_time;
+static uint8_t ui8_first_update = 1;
+
+// State of charge estimator
+//
+// The SOC is kept in 0.1 % units and is:
+// - initialized from the open circuit voltage (OCV) curve, with the voltage sag compensated with the pack resistance,
+//   at first received package or after a change of the battery configuration (cells, resistance or capacity);
+// - decreased by coulomb counting: each received package adds battery current x5 * elapsed TIM3 ticks, which is
+//   charge in units of: 0.2 A * 1.024 ms = 0.2048 mAs, so 1 Ah = 17578125 units, and every 0.1 % of battery capacity
+//   removes 0.1 % from the SOC. Capacity in Ah = Wh (user configured 100 % Wh) / battery nominal voltage;
+// - rebased to the OCV curve when battery is at rest (current under BATTERY_SOC_REST_CURRENT_X5 for BATTERY_SOC_REST_TIME_SECONDS),
+//   which corrects the drift of the coulomb counting and the capacity error.
+// Without the 100 % Wh configured, there is no capacity and the SOC simply follows the compensated OCV.
+#define CHARGE_UNITS_PER_AH_DIV1000   17578
+#define BATTERY_SOC_REST_TIME         (BATTERY_SOC_REST_TIME_SECONDS * 977) // TIM3 ticks
+#define BATTERY_SOC_VOLTAGE_FILTER    4
+#define OCV_POINTS_NUMBER             11
+
+static const uint16_t ui16_ocv_cell_volts_x100 [OCV_POINTS_NUMBER] = {
+    LI_ION_CELL_VOLTS_100_X100,
+    LI_ION_CELL_VOLTS_90_X100,
+    LI_ION_CELL_VOLTS_80_X100,
+    LI_ION_CELL_VOLTS_70_X100,
+    LI_ION_CELL_VOLTS_60_X100,
+    LI_ION_CELL_VOLTS_50_X100,
+    LI_ION_CELL_VOLTS_40_X100,
+    LI_ION_CELL_VOLTS_30_X100,
+    LI_ION_CELL_VOLTS_20_X100,
+    LI_ION_CELL_VOLTS_10_X100,
+    LI_ION_CELL_VOLTS_0_X100
+};
+
+static uint16_t ui16_ocv_adc [OCV_POINTS_NUMBER]; // pack OCV curve in motor controller ADC units, from 100 % to 0 %
+static uint16_t ui16_pack_resistance_x1000;
+static uint32_t ui32_charge_units_per_soc_x10; // charge units of 0.1 % of capacity, 0 if capacity is not configured
+static uint8_t ui8_soc_cells_number;
+static uint32_t ui32_soc_wh_x10_100_percent;
+static uint8_t ui8_soc_configured = 0;
+static uint8_t ui8_soc_init = 1;
+
+static uint16_t ui16_soc_x10;
+static uint32_t ui32_charge_remainder;
+static struct_filter soc_adc_voltage_filter;
+static uint16_t ui16_soc_rest_time;
+
+static void battery_energy_integrate (uint16_t ui16_adc_battery_voltage, uint8_t ui8_battery_current_x5, uint16_t ui16_delta_time)
+{
+  ui32_energy_remainder += ((uint32_t) ui16_adc_battery_voltage) * ((uint32_t) ui8_battery_current_x5) * ((uint32_t) ui16_delta_time);
+
+  if (ui32_energy_remainder >= ENERGY_UNITS_PER_WH_X10)
+  {
+    ui32_energy_wh_x10 += ui32_energy_remainder / ENERGY_UNITS_PER_WH_X10;
+    ui32_energy_remainder %= ENERGY_UNITS_PER_WH_X10;
+  }
+}
+
+uint32_t battery_energy_get_wh_x10 (void)
+{
+  return ui32_energy_wh_x10;
+}
+
+void battery_energy_reset (void)
+{
+  ui32_energy_wh_x10 = 0;
+  ui32_energy_remainder = 0;
+}
+
+void battery_soc_configure (uint8_t ui8_cells_number, uint16_t ui16_pack_resistance_x1000_value, uint32_t ui32_wh_x10_100_percent)
+{
+  uint8_t ui8_i;
+
+  // called on every configuration save: keep the coulomb count if the battery configuration is the same
+  if ((ui8_soc_configured) &&
+      (ui8_cells_number == ui8_soc_cells_number) &&
+      (ui16_pack_resistance_x1000_value == ui16_pack_resistance_x1000) &&
+      (ui32_wh_x10_100_percent == ui32_soc_wh_x10_100_percent))
+  {
+    return;
+  }
+
+  ui8_soc_cells_number = ui8_cells_number;
+  ui32_soc_wh_x10_100_percent = ui32_wh_x10_100_percent;
+
+  // cell volts x100 to pack motor controller ADC units: (volts_x100 * 100) / ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000
+  for (ui8_i = 0; ui8_i < OCV_POINTS_NUMBER; ui8_i++)
+  {
+    ui16_ocv_adc [ui8_i] = (uint16_t) ((((uint32_t) ui8_cells_number) * ((uint32_t) ui16_ocv_cell_volts_x100 [ui8_i]) * 100) /
+        ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000);
+  }
+
+  ui16_pack_resistance_x1000 = ui16_pack_resistance_x1000_value;
+
+  // 0.1 % of capacity = (Wh_x10 / 10) / (cells * nominal_volts_x100 / 100) * 17578125 / 1000
+  if (ui8_cells_number)
+  {
+    ui32_charge_units_per_soc_x10 = ((ui32_wh_x10_100_percent * CHARGE_UNITS_PER_AH_DIV1000) /
+        (((uint32_t) ui8_cells_number) * LI_ION_CELL_VOLTS_NOMINAL_X100)) * 10;
+  }
+  else
+  {
+    ui32_charge_units_per_soc_x10 = 0;
+  }
+
+  // start again from the OCV curve, as it may be a new battery
+  ui8_soc_configured = 1;
+  ui8_soc_init = 1;
+}
+
+static uint16_t battery_soc_from_ocv (uint16_t ui16_adc_voltage)
+{
+  uint8_t ui8_i;
+  uint16_t ui16_delta;
+
+  if (ui16_adc_voltage >= ui16_ocv_adc [0]) { return 1000; }
+  if (ui16_adc_voltage <= ui16_ocv_adc [OCV_POINTS_NUMBER - 1]) { return 0; }
+
+  // find the segment and interpolate linearly, each segment is 10 %
+  for (ui8_i = 1; ui8_i < (OCV_POINTS_NUMBER - 1); ui8_i++)
+  {
+    if (ui16_adc_voltage > ui16_ocv_adc [ui8_i]) { break; }
+  }
+
+  ui16_delta = ui16_ocv_adc [ui8_i - 1] - ui16_ocv_adc [ui8_i];
+  return ((OCV_POINTS_NUMBER - 1 - ui8_i) * 100) + ((ui16_delta == 0) ? 0 : (uint16_t) ((((uint32_t) (ui16_adc_voltage - ui16_ocv_adc [ui8_i])) * 100) / ui16_delta));
+}
+
+static void battery_soc_update (uint16_t ui16_adc_battery_voltage, uint8_t ui8_battery_current_x5, uint16_t ui16_delta_time)
+{
+  uint16_t ui16_ocv_adc_voltage;
+  uint16_t ui16_soc_decrement_x10;
+
+  if (!ui8_soc_configured) { return; }
+
+  // filter starts again from this value
+  if (ui8_soc_init) { filter_init (&soc_adc_voltage_filter, BATTERY_SOC_VOLTAGE_FILTER, 0); }
+
+  // compensate the voltage sag: R_x1000 * I_x5 / 5000 volts = R_x1000 * I_x5 * 2 / 863 ADC units
+  ui16_ocv_adc_voltage = ((uint16_t) filter_update (&soc_adc_voltage_filter, (uint32_t) ui16_adc_battery_voltage)) +
+      (uint16_t) ((((uint32_t) ui16_pack_resistance_x1000) * ((uint32_t) ui8_battery_current_x5) * 2) / ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000);
+
+  // rest detection
+  if (ui8_battery_current_x5 <= BATTERY_SOC_REST_CURRENT_X5)
+  {
+    if (ui16_soc_rest_time < BATTERY_SOC_REST_TIME) { ui16_soc_rest_time += ui16_delta_time; }
+  }
+  else
+  {
+    ui16_soc_rest_time = 0;
+  }
+
+  // (re)base on the OCV curve
+  if (ui8_soc_init ||
+      (ui16_soc_rest_time >= BATTERY_SOC_REST_TIME) ||
+      (ui32_charge_units_per_soc_x10 == 0))
+  {
+    ui8_soc_init = 0;
+    ui16_soc_x10 = battery_soc_from_ocv (ui16_ocv_adc_voltage);
+    ui32_charge_remainder = 0;
+    return;
+  }
+
+  // coulomb counting
+  ui32_charge_remainder += ((uint32_t) ui8_battery_current_x5) * ((uint32_t) ui16_delta_time);
+
+  if (ui32_charge_remainder >= ui32_charge_units_per_soc_x10)
+  {
+    ui16_soc_decrement_x10 = (uint16_t) (ui32_charge_remainder / ui32_charge_units_per_soc_x10);
+    ui32_charge_remainder %= ui32_charge_units_per_soc_x10;
+
+    if (ui16_soc_x10 > ui16_soc_decrement_x10) { ui16_soc_x10 -= ui16_soc_decrement_x10; }
+    else { ui16_soc_x10 = 0; }
+  }
+}
+
+void battery_update (uint16_t ui16_adc_battery_voltage, uint8_t ui8_battery_current_x5)
+{
+  uint16_t ui16_time;
+  uint16_t ui16_delta_time;
+
+  ui16_time = TIM3_GetCounter ();
+  ui16_delta_time = ui16_time - ui16_last_update_time;
+  ui16_last_update_time = ui16_time;
+
+  // there is no previous package time to integrate from
+  if (ui8_first_update)
+  {
+    ui8_first_update = 0;
+    return;
+  }
+
+  if (ui16_delta_time > BATTERY_MAX_DELTA_TIME) { ui16_delta_time = BATTERY_MAX_DELTA_TIME; }
+
+  battery_energy_integrate (ui16_adc_battery_voltage, ui8_battery_current_x5, ui16_delta_time);
+  battery_soc_update (ui16_adc_battery_voltage, ui8_battery_current_x5, ui16_delta_time);
+}
+
+uint16_t battery_soc_get_x10 (void)
+{
+  return ui16_soc_x10;
+}
@@ -0,0 +1,20 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _BATTERY_H_
+#define _BATTERY_H_
+
+#include "main.h"
+
+void battery_update (uint16_t ui16_adc_battery_voltage, uint8_t ui8_battery_current_x5);
+uint32_t battery_energy_get_wh_x10 (void);
+void battery_energy_reset (void);
+void battery_soc_configure (uint8_t ui8_cells_number, uint16_t ui16_pack_resistance_x1000_value, uint32_t ui32_wh_x10_100_percent);
+uint16_t battery_soc_get_x10 (void);
+
+#endif /* _BATTERY_H_ */
@@ -0,0 +1,103 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "brownout.h"
+#include "adc.h"
+#include "filter.h"
+#include "eeprom.h"
+#include "lcd.h"
+#include "config.h"
+
+// Power fail detection
+//
+// When the battery is disconnected or the motor controller cuts the power, the battery voltage measured by the LCD
+// collapses while the LCD is still powered for a short time by its capacitors. The voltage is sampled every 1ms and
+// compared with a slow filtered reference: after BROWNOUT_SAMPLES samples under the reference minus 1/4, the journal
+// record with the Wh, odometer and trip values, prepared every second, is written to EEPROM. Preparing the record
+// before (values and CRC) means only the EEPROM programming is left to do when the power is failing.
+#define BROWNOUT_STATE_MONITORING   0
+#define BROWNOUT_STATE_SAVED        1
+
+static struct_filter battery_voltage_reference;
+static uint8_t ui8_brownout_state = BROWNOUT_STATE_MONITORING;
+static uint8_t ui8_brownout_samples;
+static uint16_t ui16_brownout_stage_counter;
+static uint16_t ui16_brownout_recover_counter;
+
+void brownout_init (void)
+{
+  filter_init (&battery_voltage_reference, BROWNOUT_REFERENCE_FILTER_COEFFICIENT, 0);
+}
+
+// should be called every 1ms
+void clock_brownout (void)
+{
+  uint16_t ui16_adc_battery_voltage;
+  uint16_t ui16_threshold;
+
+  ui16_adc_battery_voltage = ui16_adc_read_battery_voltage_10b ();
+
+  // threshold is 0 before the first sample
+  ui16_threshold = (uint16_t) filter_get_output (&battery_voltage_reference);
+  ui16_threshold -= ui16_threshold >> BROWNOUT_VOLTAGE_DROP_SHIFT;
+
+  switch (ui8_brownout_state)
+  {
+    case BROWNOUT_STATE_MONITORING:
+      // the reference is not updated while the voltage is low, so it keeps the value before the power fail
+      if (ui16_adc_battery_voltage < ui16_threshold)
+      {
+        ui8_brownout_samples++;
+        if (ui8_brownout_samples >= BROWNOUT_SAMPLES)
+        {
+          // switch off the backlight to save the little energy left
+          lcd_set_backlight_intensity (0);
+          eeprom_journal_write_staged ();
+
+          ui8_brownout_state = BROWNOUT_STATE_SAVED;
+          ui16_brownout_recover_counter = 0;
+        }
+        break;
+      }
+
+      ui8_brownout_samples = 0;
+      filter_update (&battery_voltage_reference, ui16_adc_battery_voltage);
+
+      ui16_brownout_stage_counter++;
+      if (ui16_brownout_stage_counter >= BROWNOUT_STAGE_PERIOD)
+      {
+        ui16_brownout_stage_counter = 0;
+        eeprom_journal_stage (lcd_get_wh_x10 ());
+      }
+    break;
+
+    case BROWNOUT_STATE_SAVED:
+      // still powered after the voltage recovered: it was a voltage sag and not a power fail, so monitor again
+      if (ui16_adc_battery_voltage >= ui16_threshold)
+      {
+        ui16_brownout_recover_counter++;
+        if (ui16_brownout_recover_counter >= BROWNOUT_RECOVER_TIME)
+        {
+          ui8_brownout_state = BROWNOUT_STATE_MONITORING;
+          ui8_brownout_samples = 0;
+          ui16_brownout_stage_counter = 0;
+
+          // configuration save dropped by the power fail detection
+          eeprom_write_retry ();
+          eeprom_journal_stage (lcd_get_wh_x10 ());
+        }
+      }
+      else
+      {
+        ui16_brownout_recover_counter = 0;
+      }
+    break;
+  }
+}
@@ -0,0 +1,17 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _BROWNOUT_H_
+#define _BROWNOUT_H_
+
+#include "main.h"
+
+void brownout_init (void);
+void clock_brownout (void);
+
+#endif /* _BROWNOUT_H_ */
@@ -8,264 +8,506 @@
 
 #include "stm8s.h"
 #include "stm8s_gpio.h"
+#include "stm8s_tim3.h"
 #include "gpio.h"
 #include "pins.h"
+#include "config.h"
+#include "main.h"
+#include "button.h"
 
-uint8_t ui8_buttons_events = 0;
-uint8_t ui8_onoff_button_state = 0;
-uint8_t ui8_onoff_button_state_counter = 0;
-uint8_t ui8_down_button_state = 0;
-uint8_t ui8_down_button_state_counter = 0;
-uint8_t ui8_up_button_state = 0;
-uint8_t ui8_up_button_state_counter = 0;
+typedef struct _button
+{
+  GPIO_TypeDef *port;
+  uint8_t ui8_pin;
+  uint8_t ui8_pressed_level;          // input value when pressed: ui8_pin if active high, 0 if active low
+  uint8_t ui8_flags;
+  uint8_t ui8_long_click_time;        // 10ms units
+} struct_button;
+
+typedef struct _button_chord
+{
+  uint8_t ui8_buttons;                // bit for each button of the chord
+  uint8_t ui8_long_click_time;
+} struct_button_chord;
+
+static const struct_button buttons [BUTTONS_NUMBER] = {
+    { LCD3_BUTTON_ONOFF__PORT, LCD3_BUTTON_ONOFF__PIN, LCD3_BUTTON_ONOFF__PIN, BUTTON_DOUBLE_CLICK, BUTTON_LONG_CLICK_TIME },
+    { LCD3_BUTTON_DOWN__PORT, LCD3_BUTTON_DOWN__PIN, 0, BUTTON_EXTI | BUTTON_REPEAT, BUTTON_LONG_CLICK_TIME },
+    { LCD3_BUTTON_UP__PORT, LCD3_BUTTON_UP__PIN, 0, BUTTON_EXTI | BUTTON_REPEAT, BUTTON_LONG_CLICK_TIME }
+  };
+
+static const struct_button_chord chords [BUTTONS_AND_CHORDS_NUMBER - BUTTONS_NUMBER] = {
+    { (1 << BUTTON_UP) | (1 << BUTTON_DOWN), BUTTON_LONG_CLICK_TIME },
+    { (1 << BUTTON_ONOFF) | (1 << BUTTON_UP), BUTTON_LONG_CLICK_TIME },
+    { (1 << BUTTON_ONOFF) | (1 << BUTTON_DOWN), BUTTON_LONG_CLICK_TIME }
+  };
+
+#define BUTTON_STATE_IDLE             0
+#define BUTTON_STATE_PRESSED          1
+#define BUTTON_STATE_WAIT_DOUBLE      2 // released, waiting for the second click
+#define BUTTON_STATE_DOUBLE_PRESSED   3
+#define BUTTON_STATE_REPEAT           4
+#define BUTTON_STATE_WAIT_RELEASE     5
+
+// Events FIFO
+//
+// Events are queued in the order they happen. On each clock_button () the oldest one becomes the current event,
+// that the UI code can see with button_event_is () until it is consumed, and that is discarded
+// on the next clock_button () if no one used it. So each event is used only once, by the code that consumes it,
+// and quick presses are not lost or merged. Only one event is used each 10ms, so if the buttons make events faster
+// than that for a while, the FIFO gets full and the new events are lost: they are counted, see the technical menu.
+static struct_button_event buttons_events_queue [BUTTONS_EVENTS_QUEUE_SIZE];
+static uint8_t ui8_buttons_events_head;
+static uint8_t ui8_buttons_events_count;
+static uint8_t ui8_buttons_events_lost;
+static struct_button_event button_current_event;
+
+static uint8_t ui8_buttons_state [BUTTONS_AND_CHORDS_NUMBER];
+static uint8_t ui8_buttons_counter [BUTTONS_AND_CHORDS_NUMBER];
+static uint8_t ui8_buttons_repeat_interval [BUTTONS_NUMBER];
+static uint8_t ui8_buttons_hold_time [BUTTONS_NUMBER];   // time pressed while repeating, for the long click event
+static uint8_t ui8_buttons_debounce [BUTTONS_NUMBER];
+static uint8_t ui8_buttons_pressed;   // bit for each button, after debounce
+
+// Edges capture
+//
+// The port B interrupt saves the time of the last edge of BUTTON_EXTI buttons, so the input is taken as stable
+// BUTTON_DEBOUNCE_TIME after the last bounce (precise debounce). Clicks and the other events timing still counts
+// clock_button () ticks of 10ms.
+static volatile uint8_t ui8_buttons_edges;   // bit for each button with edges not debounced yet
+static volatile uint16_t ui16_buttons_last_edge_time [BUTTONS_NUMBER];
+static volatile uint8_t ui8_buttons_port_b_input;
+
+static uint8_t button_read (uint8_t ui8_button)
+{
+  return (buttons [ui8_button].port->IDR & buttons [ui8_button].ui8_pin) == buttons [ui8_button].ui8_pressed_level;
+}
+
+static void button_event_queue (uint8_t ui8_button, uint8_t ui8_type)
+{
+  struct_button_event *p_event;
+
+  // FIFO full: the new event is lost
+  if (ui8_buttons_events_count >= BUTTONS_EVENTS_QUEUE_SIZE)
+  {
+    if (ui8_buttons_events_lost < 255) { ui8_buttons_events_lost++; }
+    return;
+  }
+
+  p_event = &buttons_events_queue [(ui8_buttons_events_head + ui8_buttons_events_count) % BUTTONS_EVENTS_QUEUE_SIZE];
+  p_event->ui8_button = ui8_button;
+  p_event->ui8_type = ui8_type;
+  ui8_buttons_events_count++;
+}
+
+static void button_press (uint8_t ui8_button)
+{
+  ui8_buttons_state [ui8_button] = BUTTON_STATE_PRESSED;
+  ui8_buttons_counter [ui8_button] = 0;
+}
+
+static void button_event (uint8_t ui8_button, uint8_t ui8_type, uint8_t ui8_state)
+{
+  button_event_queue (ui8_button, ui8_type);
+  ui8_buttons_state [ui8_button] = ui8_state;
+  ui8_buttons_counter [ui8_button] = 0;
+}
+
+static void clock_button_single (uint8_t ui8_button, uint8_t ui8_pressed)
+{
+  const struct_button *p_button = &buttons [ui8_button];
+  uint8_t ui8_counter = ++ui8_buttons_counter [ui8_button];
+
+  switch (ui8_buttons_state [ui8_button])
+  {
+    case BUTTON_STATE_IDLE:
+      ui8_buttons_counter [ui8_button] = 0;
+      if (ui8_pressed) { button_press (ui8_button); }
+    break;
+
+    case BUTTON_STATE_PRESSED:
+      if (!ui8_pressed)
+      {
+        if (p_button->ui8_flags & BUTTON_DOUBLE_CLICK)
+        {
+          ui8_buttons_state [ui8_button] = BUTTON_STATE_WAIT_DOUBLE;
+          ui8_buttons_counter [ui8_button] = 0;
+        }
+        else
+        {
+          button_event (ui8_button, BUTTON_EVENT_CLICK, BUTTON_STATE_IDLE);
+        }
+      }
+      else if (p_button->ui8_flags & BUTTON_REPEAT)
+      {
+        if (ui8_counter >= BUTTON_REPEAT_DELAY)
+        {
+          ui8_buttons_hold_time [ui8_button] = ui8_counter;
+          button_event (ui8_button, BUTTON_EVENT_REPEAT, BUTTON_STATE_REPEAT);
+          ui8_buttons_repeat_interval [ui8_button] = BUTTON_REPEAT_INTERVAL;
+        }
+      }
+      else if (ui8_counter >= p_button->ui8_long_click_time)
+      {
+        button_event (ui8_button, BUTTON_EVENT_LONG_CLICK, BUTTON_STATE_WAIT_RELEASE);
+      }
+    break;
+
+    case BUTTON_STATE_WAIT_DOUBLE:
+      if (ui8_pressed)
+      {
+        ui8_buttons_state [ui8_button] = BUTTON_STATE_DOUBLE_PRESSED;
+      }
+      else if (ui8_counter >= BUTTON_DOUBLE_CLICK_TIME)
+      {
+        button_event (ui8_button, BUTTON_EVENT_CLICK, BUTTON_STATE_IDLE);
+      }
+    break;
+
+    case BUTTON_STATE_DOUBLE_PRESSED:
+      if (!ui8_pressed)
+      {
+        button_event (ui8_button, BUTTON_EVENT_DOUBLE_CLICK, BUTTON_STATE_IDLE);
+      }
+    break;
+
+    // each repeat comes faster than the previous one, until BUTTON_REPEAT_INTERVAL_MIN, and the long click event
+    // is sent as for the buttons without repeat, so the same button can have both uses
+    case BUTTON_STATE_REPEAT:
+      if (!ui8_pressed)
+      {
+        ui8_buttons_state [ui8_button] = BUTTON_STATE_IDLE;
+        break;
+      }
+
+      if (ui8_buttons_hold_time [ui8_button] < 255)
+      {
+        if (++ui8_buttons_hold_time [ui8_button] == p_button->ui8_long_click_time)
+        {
+          button_event_queue (ui8_button, BUTTON_EVENT_LONG_CLICK);
+        }
+      }
+
+      if (ui8_counter >= ui8_buttons_repeat_interval [ui8_button])
+      {
+        button_event (ui8_button, BUTTON_EVENT_REPEAT, BUTTON_STATE_REPEAT);
+
+        ui8_buttons_repeat_interval [ui8_button] -= ui8_buttons_repeat_interval [ui8_button] >> 2;
+        if (ui8_buttons_repeat_interval [ui8_button] < BUTTON_REPEAT_INTERVAL_MIN)
+        {
+          ui8_buttons_repeat_interval [ui8_button] = BUTTON_REPEAT_INTERVAL_MIN;
+        }
+      }
+    break;
+
+    default:
+      if (!ui8_pressed)
+      {
+        ui8_buttons_state [ui8_button] = BUTTON_STATE_IDLE;
+      }
+    break;
+  }
+}
+
+// click event when released before the long click time, long click event after it
+static void clock_button_chord (uint8_t ui8_chord, uint8_t *ui8_chords_buttons)
+{
+  const struct_button_chord *p_chord = &chords [ui8_chord - BUTTONS_NUMBER];
+  uint8_t ui8_all_pressed = (ui8_buttons_pressed & p_chord->ui8_buttons) == p_chord->ui8_buttons;
+
+  switch (ui8_buttons_state [ui8_chord])
+  {
+    case BUTTON_STATE_IDLE:
+      // a button can be on only one chord at a time
+      if (ui8_all_pressed && !(*ui8_chords_buttons & p_chord->ui8_buttons))
+      {
+        button_press (ui8_chord);
+        *ui8_chords_buttons |= p_chord->ui8_buttons;
+      }
+    break;
+
+    case BUTTON_STATE_PRESSED:
+      if (!ui8_all_pressed)
+      {
+        button_event (ui8_chord, BUTTON_EVENT_CLICK, BUTTON_STATE_WAIT_RELEASE);
+      }
+      else if (++ui8_buttons_counter [ui8_chord] >= p_chord->ui8_long_click_time)
+      {
+        button_event (ui8_chord, BUTTON_EVENT_LONG_CLICK, BUTTON_STATE_WAIT_RELEASE);
+      }
+    break;
+
+    default:
+      // wait for all the buttons release
+      if (!(ui8_buttons_pressed & p_chord->ui8_buttons))
+      {
+        ui8_buttons_state [ui8_chord] = BUTTON_STATE_IDLE;
+      }
+    break;
+  }
+}
+
+void button_init (void)
+{
+  ui8_buttons_port_b_input = GPIOB->IDR;
+}
+
+void EXTI_PORTB_IRQHandler (void) __interrupt(EXTI_PORTB_IRQHANDLER)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_changed;
+  uint16_t ui16_time;
+
+  // TIM3 counter high byte must be read first, the low byte is latched
+  ui16_time = ((uint16_t) TIM3->CNTRH) << 8;
+  ui16_time |= TIM3->CNTRL;
+
+  ui8_changed = GPIOB->IDR ^ ui8_buttons_port_b_input;
+  ui8_buttons_port_b_input ^= ui8_changed;
+
+  for (ui8_i = 0; ui8_i < BUTTONS_NUMBER; ui8_i++)
+  {
+    if ((buttons [ui8_i].ui8_flags & BUTTON_EXTI) &&
+        (ui8_changed & buttons [ui8_i].ui8_pin))
+    {
+      ui16_buttons_last_edge_time [ui8_i] = ui16_time;
+      ui8_buttons_edges |= (1 << ui8_i);
+    }
+  }
+}
+
+// debounce: the input must be at the same level for BUTTON_DEBOUNCE_TIME to change the state,
+// should be called every 1ms
+void clock_button_inputs (void)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_pressed;
+  uint8_t ui8_stable;
+
+  for (ui8_i = 0; ui8_i < BUTTONS_NUMBER; ui8_i++)
+  {
+    if (buttons [ui8_i].ui8_flags & BUTTON_EXTI)
+    {
+      if (!(ui8_buttons_edges & (1 << ui8_i))) { continue; }
+
+      disableInterrupts ();
+      ui8_stable = ((uint16_t) (TIM3_GetCounter () - ui16_buttons_last_edge_time [ui8_i])) >= BUTTON_DEBOUNCE_TIME;
+      if (ui8_stable) { ui8_buttons_edges &= ~(1 << ui8_i); }
+      enableInterrupts ();
+
+      if (!ui8_stable) { continue; }
+
+      ui8_pressed = button_read (ui8_i);
+    }
+    else
+    {
+      if (button_read (ui8_i))
+      {
+        if (ui8_buttons_debounce [ui8_i] < BUTTON_DEBOUNCE_TIME) { ui8_buttons_debounce [ui8_i]++; }
+      }
+      else
+      {
+        if (ui8_buttons_debounce [ui8_i] > 0) { ui8_buttons_debounce [ui8_i]--; }
+      }
+
+      if (ui8_buttons_debounce [ui8_i] == BUTTON_DEBOUNCE_TIME) { ui8_pressed = 1; }
+      else if (ui8_buttons_debounce [ui8_i] == 0) { ui8_pressed = 0; }
+      else { continue; }
+    }
+
+    if (ui8_pressed && !(ui8_buttons_pressed & (1 << ui8_i)))
+    {
+      ui8_buttons_pressed |= (1 << ui8_i);
+      button_event_queue (ui8_i, BUTTON_EVENT_PRESS);
+    }
+    else if (!ui8_pressed && (ui8_buttons_pressed & (1 << ui8_i)))
+    {
+      ui8_buttons_pressed &= ~(1 << ui8_i);
+      button_event_queue (ui8_i, BUTTON_EVENT_RELEASE);
+    }
+  }
+}
+
+// should be called every 10ms
+void clock_button (void)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_chords_buttons = 0;
+
+  // buttons of the active chords
+  for (ui8_i = BUTTONS_NUMBER; ui8_i < BUTTONS_AND_CHORDS_NUMBER; ui8_i++)
+  {
+    if (ui8_buttons_state [ui8_i] != BUTTON_STATE_IDLE)
+    {
+      ui8_chords_buttons |= chords [ui8_i - BUTTONS_NUMBER].ui8_buttons;
+    }
+  }
+
+  for (ui8_i = BUTTONS_NUMBER; ui8_i < BUTTONS_AND_CHORDS_NUMBER; ui8_i++)
+  {
+    clock_button_chord (ui8_i, &ui8_chords_buttons);
+  }
+
+  // while a button is on a chord, there are no events of the button alone, like ONOFF long click to power off
+  for (ui8_i = 0; ui8_i < BUTTONS_NUMBER; ui8_i++)
+  {
+    if (ui8_chords_buttons & (1 << ui8_i))
+    {
+      ui8_buttons_state [ui8_i] = BUTTON_STATE_WAIT_RELEASE;
+    }
+
+    clock_button_single (ui8_i, ui8_buttons_pressed & (1 << ui8_i));
+  }
+
+  // the current event not used is discarded, the next one on the FIFO becomes the current event
+  button_current_event.ui8_type = BUTTON_EVENT_NONE;
+  if (ui8_buttons_events_count)
+  {
+    button_current_event = buttons_events_queue [ui8_buttons_events_head];
+    ui8_buttons_events_head = (ui8_buttons_events_head + 1) % BUTTONS_EVENTS_QUEUE_SIZE;
+    ui8_buttons_events_count--;
+  }
+}
+
+uint8_t button_event_is (uint8_t ui8_button, uint8_t ui8_type)
+{
+  return (button_current_event.ui8_type == ui8_type) && (button_current_event.ui8_button == ui8_button);
+}
+
+// the current event was used, no other code will see it
+void button_event_consume (void)
+{
+  button_current_event.ui8_type = BUTTON_EVENT_NONE;
+}
+
+static void button_event_clear (uint8_t ui8_button, uint8_t ui8_type)
+{
+  if (button_event_is (ui8_button, ui8_type)) { button_event_consume (); }
+}
+
+// returns 1 if there are events to use or buttons pressed
+uint8_t button_get_events (void)
+{
+  return (button_current_event.ui8_type != BUTTON_EVENT_NONE) || ui8_buttons_events_count || ui8_buttons_pressed;
+}
+
+// events lost because the FIFO was full, up to 255
+uint8_t button_get_events_lost (void)
+{
+  return ui8_buttons_events_lost;
+}
 
 uint8_t get_button_up_state (void)
 {
-  return GPIO_ReadInputPin(LCD3_BUTTON_UP__PORT, LCD3_BUTTON_UP__PIN) != 0 ? 0: 1;
+  return button_read (BUTTON_UP);
 }
 
 uint8_t get_button_up_click_event (void)
 {
-  return (ui8_buttons_events & (1 << 4));
+  return button_event_is (BUTTON_UP, BUTTON_EVENT_CLICK);
 }
 
 uint8_t get_button_up_long_click_event (void)
 {
-  return (ui8_buttons_events & (1 << 5));
+  return button_event_is (BUTTON_UP, BUTTON_EVENT_LONG_CLICK);
 }
 
 void clear_button_up_click_event (void)
 {
-  ui8_buttons_events &= ~(1 << 4);
+  button_event_clear (BUTTON_UP, BUTTON_EVENT_CLICK);
 }
 
 void clear_button_up_long_click_event (void)
 {
-  ui8_buttons_events &= ~((1 << 5) + (1 << 4));
+  button_event_clear (BUTTON_UP, BUTTON_EVENT_LONG_CLICK);
 }
 
 uint8_t get_button_down_state (void)
 {
-  return GPIO_ReadInputPin(LCD3_BUTTON_DOWN__PORT, LCD3_BUTTON_DOWN__PIN) != 0 ? 0: 1;
+  return button_read (BUTTON_DOWN);
 }
 
 uint8_t get_button_down_click_event (void)
 {
-  return (ui8_buttons_events & (1 << 2));
+  return button_event_is (BUTTON_DOWN, BUTTON_EVENT_CLICK);
 }
 
 uint8_t get_button_down_long_click_event (void)
 {
-  return (ui8_buttons_events & (1 << 3));
+  return button_event_is (BUTTON_DOWN, BUTTON_EVENT_LONG_CLICK);
 }
 
 void clear_button_down_click_event (void)
 {
-  ui8_buttons_events &= ~(1 << 2);
+  button_event_clear (BUTTON_DOWN, BUTTON_EVENT_CLICK);
 }
 
 void clear_button_down_long_click_event (void)
 {
-  ui8_buttons_events &= ~((1 << 3) + (1 << 2));
+  button_event_clear (BUTTON_DOWN, BUTTON_EVENT_LONG_CLICK);
 }
 
 uint8_t get_button_onoff_state (void)
 {
-  return GPIO_ReadInputPin(LCD3_BUTTON_ONOFF__PORT, LCD3_BUTTON_ONOFF__PIN) != 0 ? 1: 0;
+  return button_read (BUTTON_ONOFF);
 }
 
 uint8_t get_button_onoff_click_event (void)
 {
-  return (ui8_buttons_events & (1 << 0));
+  return button_event_is (BUTTON_ONOFF, BUTTON_EVENT_CLICK);
 }
 
 uint8_t get_button_onoff_long_click_event (void)
 {
-  return (ui8_buttons_events & (1 << 1));
+  return button_event_is (BUTTON_ONOFF, BUTTON_EVENT_LONG_CLICK);
 }
 
 void clear_button_onoff_click_event (void)
 {
-  ui8_buttons_events &= ~(1 << 0);
+  button_event_clear (BUTTON_ONOFF, BUTTON_EVENT_CLICK);
 }
 
 void clear_button_onoff_long_click_event (void)
 {
-  ui8_buttons_events &= ~((1 << 1) + (1 << 0));
+  button_event_clear (BUTTON_ONOFF, BUTTON_EVENT_LONG_CLICK);
 }
 
-uint8_t get_button_up_down_click_event (void)
+uint8_t get_button_up_down_long_click_event (void)
 {
-  if (ui8_buttons_events & (1 << 6))
-    return 1;
-  return 0;
+  return button_event_is (BUTTON_UP_DOWN, BUTTON_EVENT_LONG_CLICK);
 }
 
-void clear_button_up_down_click_event (void)
+void clear_button_up_down_long_click_event (void)
 {
-  ui8_buttons_events &= ~(1 << 6);
+  button_event_clear (BUTTON_UP_DOWN, BUTTON_EVENT_LONG_CLICK);
 }
 
-uint8_t button_get_events (void)
+uint8_t get_button_onoff_up_click_event (void)
 {
-  return ui8_buttons_events;
+  return button_event_is (BUTTON_ONOFF_UP, BUTTON_EVENT_CLICK);
 }
 
-void button_clear_events (void)
+void clear_button_onoff_up_click_event (void)
 {
-  ui8_buttons_events = 0;
-  ui8_onoff_button_state = 0;
-  ui8_up_button_state = 0;
-  ui8_down_button_state = 0;
+  button_event_clear (BUTTON_ONOFF_UP, BUTTON_EVENT_CLICK);
 }
 
-void clock_button (void)
+uint8_t get_button_onoff_down_click_event (void)
 {
-  switch (ui8_onoff_button_state)
-  {
-    case 0:
-      if (!get_button_onoff_click_event () &&
-          !get_button_onoff_long_click_event () &&
-          get_button_onoff_state ())
-        {
-          ui8_onoff_button_state = 1;
-        }
-    break;
-
-    case 1:
-      // wait for button release; event click
-      if (!get_button_onoff_state ())
-      {
-        ui8_onoff_button_state = 0;
-        ui8_onoff_button_state_counter = 0;
-        ui8_buttons_events |= (1 << 0);
-      }
-
-      // event long click
-      if (ui8_onoff_button_state_counter++ > 200) // 2 seconds
-      {
-        ui8_onoff_button_state = 2;
-        ui8_onoff_button_state_counter = 0;
-        ui8_buttons_events |= (1 << 1);
-      }
-    break;
-
-    case 2:
-      // wait for button release
-      if (!get_button_onoff_state ())
-      {
-        ui8_onoff_button_state = 0;
-      }
-    break;
-
-    default:
-      ui8_onoff_button_state = 0;
-    break;
-  }
-
-  switch (ui8_down_button_state)
-  {
-    case 0:
-      if (!(get_button_down_click_event () &&
-          get_button_down_long_click_event () &&
-          get_button_up_down_click_event ()) &&
-          get_button_down_state ())
-      {
-        ui8_down_button_state = 1;
-      }
-    break;
-
-    case 1:
-      // wait for button release; event click
-      if (!get_button_down_state ())
-      {
-        ui8_down_button_state = 0;
-        ui8_down_button_state_counter = 0;
-        ui8_buttons_events |= (1 << 2);
-      }
-
-      // event long click
-      if (ui8_down_button_state_counter++ > 200) // 2 seconds
-      {
-        // up and down button click
-        if (ui8_up_button_state == 1)
-        {
-          ui8_buttons_events |= (1 << 6);
-          ui8_up_button_state = 2;
-        }
-        else
-        {
-          ui8_buttons_events |= (1 << 3);
-        }
-
-        ui8_down_button_state = 2;
-        ui8_down_button_state_counter = 0;
-      }
-    break;
-
-    case 2:
-      // wait for button release
-      if (!get_button_down_state ())
-      {
-        ui8_down_button_state = 0;
-      }
-    break;
-
-    default:
-      ui8_down_button_state = 0;
-    break;
-  }
-
-  switch (ui8_up_button_state)
-  {
-    case 0:
-      if (!(get_button_up_click_event () &&
-          get_button_up_long_click_event () &&
-          get_button_up_down_click_event ()) &&
-          get_button_up_state ())
-      {
-        ui8_up_button_state = 1;
-      }
-    break;
-
-    case 1:
-      // wait for button release; event click
-      if (!get_button_up_state ())
-      {
-        ui8_up_button_state = 0;
-        ui8_up_button_state_counter = 0;
-        ui8_buttons_events |= (1 << 4);
-      }
-
-      // event long click
-      if (ui8_up_button_state_counter++ > 200) // 200 seconds
-      {
-        // up and down button click
-        if (ui8_down_button_state == 1)
-        {
-          ui8_buttons_events |= (1 << 6);
-          ui8_down_button_state = 2;
-        }
-        else
-        {
-          ui8_buttons_events |= (1 << 5);
-        }
+  return button_event_is (BUTTON_ONOFF_DOWN, BUTTON_EVENT_CLICK);
+}
 
-        ui8_up_button_state = 2;
-        ui8_up_button_state_counter = 0;
-      }
-    break;
+uint8_t get_button_onoff_down_long_click_event (void)
+{
+  return button_event_is (BUTTON_ONOFF_DOWN, BUTTON_EVENT_LONG_CLICK);
+}
 
-    case 2:
-      // wait for button release
-      if (!get_button_up_state ())
-      {
-        ui8_up_button_state = 0;
-      }
-    break;
+void clear_button_onoff_down_click_event (void)
+{
+  button_event_clear (BUTTON_ONOFF_DOWN, BUTTON_EVENT_CLICK);
+}
 
-    default:
-      ui8_up_button_state = 0;
-    break;
-  }
+void clear_button_onoff_down_long_click_event (void)
+{
+  button_event_clear (BUTTON_ONOFF_DOWN, BUTTON_EVENT_LONG_CLICK);
 }
@@ -12,6 +12,49 @@
 #include "main.h"
 #include "stm8s_gpio.h"
 
+// buttons, on the order of the buttons table, see button.c
+#define BUTTON_ONOFF                0
+#define BUTTON_DOWN                 1
+#define BUTTON_UP                   2
+#define BUTTONS_NUMBER              3
+
+// chords: buttons pressed together, on the order of the chords table
+#define BUTTON_UP_DOWN              3
+#define BUTTON_ONOFF_UP             4
+#define BUTTON_ONOFF_DOWN           5
+#define BUTTONS_AND_CHORDS_NUMBER   6
+
+// events types, press and release are only for buttons, not for chords
+#define BUTTON_EVENT_NONE           0
+#define BUTTON_EVENT_PRESS          1
+#define BUTTON_EVENT_RELEASE        2
+#define BUTTON_EVENT_CLICK          3
+#define BUTTON_EVENT_LONG_CLICK     4
+#define BUTTON_EVENT_DOUBLE_CLICK   5
+#define BUTTON_EVENT_REPEAT         6
+
+// events wait on a FIFO until they are used, see button.c
+#define BUTTONS_EVENTS_QUEUE_SIZE   8
+
+typedef struct _button_event
+{
+  uint8_t ui8_button;
+  uint8_t ui8_type;
+} struct_button_event;
+
+// buttons table flags
+#define BUTTON_DOUBLE_CLICK         1 // click event is delayed by BUTTON_DOUBLE_CLICK_TIME to detect double click
+#define BUTTON_REPEAT               2 // repeat events while pressed, the long click event is still sent
+#define BUTTON_EXTI                 4 // edges captured by the port B interrupt
+
+void button_init (void);
+void clock_button_inputs (void);
+void clock_button (void);
+uint8_t button_event_is (uint8_t ui8_button, uint8_t ui8_type);
+void button_event_consume (void);
+uint8_t button_get_events (void);
+uint8_t button_get_events_lost (void);
+
 uint8_t get_button_up_state (void);
 uint8_t get_button_up_click_event (void);
 uint8_t get_button_up_long_click_event (void);
@@ -27,10 +70,13 @@ uint8_t get_button_onoff_click_event (void);
 uint8_t get_button_onoff_long_click_event (void);
 void clear_button_onoff_click_event (void);
 void clear_button_onoff_long_click_event (void);
-uint8_t get_button_up_down_click_event (void);
-void clear_button_up_down_click_event (void);
-void clock_button (void);
-uint8_t button_get_events (void);
-void button_clear_events (void);
+uint8_t get_button_up_down_long_click_event (void);
+void clear_button_up_down_long_click_event (void);
+uint8_t get_button_onoff_up_click_event (void);
+void clear_button_onoff_up_click_event (void);
+uint8_t get_button_onoff_down_click_event (void);
+uint8_t get_button_onoff_down_long_click_event (void);
+void clear_button_onoff_down_click_event (void);
+void clear_button_onoff_down_long_click_event (void);
 
 #endif /* _BUTTON_H_ */
@@ -13,21 +13,52 @@
 // 30.0V --> 447 | 0.0671 volts per each ADC unit
 // 40.0V --> 595 | 0.0672 volts per each ADC unit
 
-#define LI_ION_CELL_VOLTS_100   4.06
-#define LI_ION_CELL_VOLTS_80    3.93
-#define LI_ION_CELL_VOLTS_60    3.78
-#define LI_ION_CELL_VOLTS_40    3.60
-#define LI_ION_CELL_VOLTS_20    3.38
-#define LI_ION_CELL_VOLTS_10    3.25
-#define LI_ION_CELL_VOLTS_0     3.00
+// Li-ion cell voltages in 0.01 volts units (integer only, so no float math is needed at runtime)
+// open circuit voltage (battery at rest) at each 10% of state of charge
+#define LI_ION_CELL_VOLTS_100_X100   406
+#define LI_ION_CELL_VOLTS_90_X100    400
+#define LI_ION_CELL_VOLTS_80_X100    393
+#define LI_ION_CELL_VOLTS_70_X100    386
+#define LI_ION_CELL_VOLTS_60_X100    378
+#define LI_ION_CELL_VOLTS_50_X100    369
+#define LI_ION_CELL_VOLTS_40_X100    360
+#define LI_ION_CELL_VOLTS_30_X100    349
+#define LI_ION_CELL_VOLTS_20_X100    338
+#define LI_ION_CELL_VOLTS_10_X100    325
+#define LI_ION_CELL_VOLTS_0_X100     300
+#define LI_ION_CELL_VOLTS_NOMINAL_X100 360
+
+// battery state of charge: battery is considered at rest after this time with current under the rest current
+#define BATTERY_SOC_REST_CURRENT_X5  1  // 0.2 amps
+#define BATTERY_SOC_REST_TIME_SECONDS 30
 
 // Battery voltage (readed on motor controller):
 #define ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000 863
 
-// Possible values: 0, 1, 2, 3, 4, 5, 6
-// 0 equal to no filtering and no delay, higher values will increase filtering but will also add bigger delay
-#define BATTERY_VOLTAGE_FILTER_COEFFICIENT 6
-#define BATTERY_CURRENT_FILTER_COEFFICIENT 5
-#define TORQUE_FILTER_COEFFICIENT          5
+// Filters coefficients are configured on the LCD menu and stored on EEPROM.
+// When fast response is enabled for a filter, a step change bigger than this values (on the filter input units)
+// is followed immediately by the filtered value
+#define BATTERY_VOLTAGE_FILTER_FAST_RESPONSE_THRESHOLD  20000 // 2 volts (x10000)
+#define BATTERY_CURRENT_FILTER_FAST_RESPONSE_THRESHOLD  25    // 5 amps (x5)
+#define PEDAL_TORQUE_FILTER_FAST_RESPONSE_THRESHOLD     1000  // 100 watts (x10)
+
+// Power fail detection, see brownout.c
+#define BROWNOUT_REFERENCE_FILTER_COEFFICIENT   7     // reference follows the battery voltage with ~128ms time constant
+#define BROWNOUT_VOLTAGE_DROP_SHIFT             2     // power fail when the voltage drops 1/4 under the reference
+#define BROWNOUT_SAMPLES                        3     // for this number of consecutive samples (1ms each)
+#define BROWNOUT_STAGE_PERIOD                   1000  // values saved on power fail are updated each 1s (1ms units)
+#define BROWNOUT_RECOVER_TIME                   500   // monitor again after the voltage is good for 0.5s (1ms units)
+
+// Buttons, see button.c (10ms units, except the debounce time)
+#define BUTTON_DEBOUNCE_TIME                    20    // the input must be stable for 20ms (1ms units)
+#define BUTTON_LONG_CLICK_TIME                  200   // 2 seconds
+#define BUTTON_DOUBLE_CLICK_TIME                30    // second click must start before 0.3s
+#define BUTTON_REPEAT_DELAY                     50    // first repeat after 0.5s pressed
+#define BUTTON_REPEAT_INTERVAL                  20    // next ones start each 0.2s and get faster
+#define BUTTON_REPEAT_INTERVAL_MIN              4     // until each 40ms
+
+// Configuration menus values editing, see lcd.c
+#define MENU_EDIT_ACCELERATION_REPEATS          10    // steps 10 times bigger after 10 repeats, 100 times after 20
+#define MENU_EDIT_DIGITS_MIN_STEPS              100   // digit by digit entry for values with at least 100 steps
 
 #endif /* CONFIG_H_ */
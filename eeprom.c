@@ -7,331 +7,1126 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#include <stddef.h>
 #include "stm8s.h"
 #include "stm8s_flash.h"
+#include "stm8s_tim3.h"
 #include "eeprom.h"
 #include "main.h"
+#include "config.h"
 #include "lcd.h"
+#include "utils.h"
+#include "filter.h"
 
-static uint8_t array_default_values [EEPROM_BYTES_STORED] = {
-    KEY,
-    DEFAULT_VALUE_ASSIST_LEVEL,
-    DEFAULT_VALUE_WHEEL_PERIMETER_0,
-    DEFAULT_VALUE_WHEEL_PERIMETER_1,
-    DEFAULT_VALUE_WHEEL_MAX_SPEED,
-    DEFAULT_VALUE_UNITS_TYPE,
-    DEFAULT_VALUE_WH_OFFSET,
-    DEFAULT_VALUE_WH_OFFSET,
-    DEFAULT_VALUE_WH_OFFSET,
-    DEFAULT_VALUE_WH_OFFSET,
-    DEFAULT_VALUE_HW_X10_100_PERCENT,
-    DEFAULT_VALUE_HW_X10_100_PERCENT,
-    DEFAULT_VALUE_HW_X10_100_PERCENT,
-    DEFAULT_VALUE_HW_X10_100_PERCENT,
-    DEAFULT_VALUE_SHOW_NUMERIC_BATTERY_SOC,
-    DEFAULT_VALUE_ODOMETER_FIELD_STATE,
-    DEFAULT_VALUE_BATTERY_MAX_CURRENT,
-    DEFAULT_VALUE_TARGET_MAX_BATTERY_POWER,
-    DEFAULT_VALUE_BATTERY_CELLS_NUMBER,
-    DEFAULT_VALUE_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0,
-    DEFAULT_VALUE_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1,
-    DEFAULT_VALUE_PAS_MAX_CADENCE,
-    DEFAULT_VALUE_CONFIG_0,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_1,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_2,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_3,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_4,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_5,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_6,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_7,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_8,
-    DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_9,
-    DEFAULT_VALUE_NUMBER_OF_ASSIST_LEVELS,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_STATE,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_1,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_2,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_3,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_4,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_5,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_6,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_7,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_8,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_9,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_TIME,
-    DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_FADE_TIME,
-    DEFAULT_VALUE_MOTOR_TEMPERATURE_MIN_VALUE_LIMIT,
-    DEFAULT_VALUE_MOTOR_TEMPERATURE_MAX_VALUE_LIMIT,
-    DEFAULT_VALUE_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_0,
-    DEFAULT_VALUE_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_1,
-    DEFAULT_VALUE_LCD_POWER_OFF_TIME,
-    DEFAULT_VALUE_LCD_BACKLIGHT_ON_BRIGHTNESS,
-    DEFAULT_VALUE_LCD_BACKLIGHT_OFF_BRIGHTNESS,
-    DEFAULT_VALUE_BATTERY_PACK_RESISTANCE_0,
-    DEFAULT_VALUE_BATTERY_PACK_RESISTANCE_1,
-    DEFAULT_VALUE_OFFROAD_FUNC_ENABLED,
-    DEFAULT_VALUE_OFFROAD_MODE_ENABLED_ON_STARTUP,
-    DEFAULT_VALUE_OFFROAD_SPEED_LIMIT,
-    DEFAULT_VALUE_OFFROAD_POWER_LIMIT_ENABLED,
-    DEFAULT_VALUE_OFFROAD_POWER_LIMIT_DIV25,
-    DEFAULT_VALUE_ODOMETER_X10,
-    DEFAULT_VALUE_ODOMETER_X10,
-    DEFAULT_VALUE_ODOMETER_X10
+#define EEPROM_FIELD(address, variable, eeprom_size, flags, default_value, min, max) \
+    { address, offsetof (struct_configuration_variables, variable), sizeof (((struct_configuration_variables *) 0)->variable), \
+      eeprom_size, 0, 0, flags, default_value, min, max }
+
+#define EEPROM_FIELD_BITS(address, variable, bit_shift, bit_mask, default_value, max) \
+    { address, offsetof (struct_configuration_variables, variable), 1, 1, bit_shift, bit_mask, 0, default_value, 0, max }
+
+// EEPROM memory layout of the configuration variables: address, variable, bytes on EEPROM, flags, default value and
+// valid range. Values out of the valid range, like on a corrupted or never written EEPROM, are replaced by the default.
+// tools/eeprom_tool.py reads this table to decode and build EEPROM images, keep the arguments as numbers or defines.
+static const struct_eeprom_field eeprom_schema [] = {
+    EEPROM_FIELD (1, ui8_assist_level, 1, 0, DEFAULT_VALUE_ASSIST_LEVEL, 0, 9),
+    EEPROM_FIELD (2, ui16_wheel_perimeter, 2, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_WHEEL_PERIMETER, 750, 3000),
+    EEPROM_FIELD (4, ui8_wheel_max_speed, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_WHEEL_MAX_SPEED, 1, 99),
+    EEPROM_FIELD (5, ui8_units_type, 1, 0, DEFAULT_VALUE_UNITS_TYPE, 0, 1),
+    EEPROM_FIELD (6, ui32_wh_x10_offset, 4, EEPROM_FIELD_JOURNAL, DEFAULT_VALUE_WH_OFFSET, 0, 0xffffffff),
+    EEPROM_FIELD (10, ui32_wh_x10_100_percent, 4, 0, DEFAULT_VALUE_HW_X10_100_PERCENT, 0, 99900),
+    EEPROM_FIELD (14, ui8_show_numeric_battery_soc, 1, 0, DEFAULT_VALUE_SHOW_NUMERIC_BATTERY_SOC, 0, 3),
+    EEPROM_FIELD (15, ui8_odometer_field_state, 1, 0, DEFAULT_VALUE_ODOMETER_FIELD_STATE, 0, 15),
+    EEPROM_FIELD (16, ui8_battery_max_current, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_BATTERY_MAX_CURRENT, 0, 100),
+    EEPROM_FIELD (17, ui8_target_max_battery_power, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_TARGET_MAX_BATTERY_POWER, 0, 190),
+    EEPROM_FIELD (18, ui8_battery_cells_number, 1, 0, DEFAULT_VALUE_BATTERY_CELLS_NUMBER, 7, 15),
+    EEPROM_FIELD (19, ui16_battery_low_voltage_cut_off_x10, 2, 0, DEFAULT_VALUE_BATTERY_LOW_VOLTAGE_CUT_OFF_X10, BATTERY_VOLTAGE_X10_MIN, BATTERY_VOLTAGE_X10_MAX),
+    EEPROM_FIELD (21, ui8_pas_max_cadence, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_PAS_MAX_CADENCE, PAS_MAX_CADENCE_MIN, PAS_MAX_CADENCE_MAX),
+    EEPROM_FIELD_BITS (22, ui8_motor_voltage_type, 0, 1, DEFAULT_VALUE_MOTOR_VOLTAGE_TYPE, 1),
+    EEPROM_FIELD_BITS (22, ui8_motor_assistance_startup_without_pedal_rotation, 1, 1, DEFAULT_VALUE_MOTOR_ASSISTANCE_WITHOUT_PEDAL_ROTATION, 1),
+    EEPROM_FIELD_BITS (22, ui8_throttle_adc_measures_motor_temperature, 2, 1, DEFAULT_VALUE_THROTTLE_ADC_MEASURES_MOTOR_TEMPERATURE, 1),
+    EEPROM_FIELD_BITS (22, ui8_temperature_field_config, 3, 3, DEFAULT_VALUE_TEMPERATURE_FIELD_CONFIG, 2),
+    EEPROM_FIELD (23, ui8_assist_level_power [0], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_1, 0, 255),
+    EEPROM_FIELD (24, ui8_assist_level_power [1], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_2, 0, 255),
+    EEPROM_FIELD (25, ui8_assist_level_power [2], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_3, 0, 255),
+    EEPROM_FIELD (26, ui8_assist_level_power [3], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_4, 0, 255),
+    EEPROM_FIELD (27, ui8_assist_level_power [4], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_5, 0, 255),
+    EEPROM_FIELD (28, ui8_assist_level_power [5], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_6, 0, 255),
+    EEPROM_FIELD (29, ui8_assist_level_power [6], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_7, 0, 255),
+    EEPROM_FIELD (30, ui8_assist_level_power [7], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_8, 0, 255),
+    EEPROM_FIELD (31, ui8_assist_level_power [8], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_9, 0, 255),
+    EEPROM_FIELD (32, ui8_number_of_assist_levels, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_NUMBER_OF_ASSIST_LEVELS, 1, 9),
+    EEPROM_FIELD (33, ui8_startup_motor_power_boost_state, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_STATE, 0, 3),
+    EEPROM_FIELD (34, ui8_startup_motor_power_boost [0], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_1, 0, 255),
+    EEPROM_FIELD (35, ui8_startup_motor_power_boost [1], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_2, 0, 255),
+    EEPROM_FIELD (36, ui8_startup_motor_power_boost [2], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_3, 0, 255),
+    EEPROM_FIELD (37, ui8_startup_motor_power_boost [3], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_4, 0, 255),
+    EEPROM_FIELD (38, ui8_startup_motor_power_boost [4], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_5, 0, 255),
+    EEPROM_FIELD (39, ui8_startup_motor_power_boost [5], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_6, 0, 255),
+    EEPROM_FIELD (40, ui8_startup_motor_power_boost [6], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_7, 0, 255),
+    EEPROM_FIELD (41, ui8_startup_motor_power_boost [7], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_8, 0, 255),
+    EEPROM_FIELD (42, ui8_startup_motor_power_boost [8], 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_9, 0, 255),
+    EEPROM_FIELD (43, ui8_startup_motor_power_boost_time, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_TIME, 0, 255),
+    EEPROM_FIELD (44, ui8_startup_motor_power_boost_fade_time, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_FADE_TIME, 0, 255),
+    EEPROM_FIELD (45, ui8_motor_temperature_min_value_to_limit, 1, 0, DEFAULT_VALUE_MOTOR_TEMPERATURE_MIN_VALUE_LIMIT, 0, 110),
+    EEPROM_FIELD (46, ui8_motor_temperature_max_value_to_limit, 1, 0, DEFAULT_VALUE_MOTOR_TEMPERATURE_MAX_VALUE_LIMIT, 0, 110),
+    EEPROM_FIELD (47, ui16_battery_voltage_reset_wh_counter_x10, 2, 0, DEFAULT_VALUE_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10, BATTERY_VOLTAGE_X10_MIN, BATTERY_VOLTAGE_X10_MAX),
+    EEPROM_FIELD (49, ui8_lcd_power_off_time_minutes, 1, 0, DEFAULT_VALUE_LCD_POWER_OFF_TIME, 0, LCD_POWER_OFF_TIME_MAX),
+    EEPROM_FIELD (50, ui8_lcd_backlight_on_brightness, 1, 0, DEFAULT_VALUE_LCD_BACKLIGHT_ON_BRIGHTNESS, 0, 20),
+    EEPROM_FIELD (51, ui8_lcd_backlight_off_brightness, 1, 0, DEFAULT_VALUE_LCD_BACKLIGHT_OFF_BRIGHTNESS, 0, 20),
+    EEPROM_FIELD (52, ui16_battery_pack_resistance_x1000, 2, 0, DEFAULT_VALUE_BATTERY_PACK_RESISTANCE, 0, 1001),
+    EEPROM_FIELD (54, ui8_offroad_func_enabled, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_OFFROAD_FUNC_ENABLED, 0, 1),
+    EEPROM_FIELD (55, ui8_offroad_enabled_on_startup, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_OFFROAD_MODE_ENABLED_ON_STARTUP, 0, 1),
+    EEPROM_FIELD (56, ui8_offroad_speed_limit, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_OFFROAD_SPEED_LIMIT, 1, 99),
+    EEPROM_FIELD (57, ui8_offroad_power_limit_enabled, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_OFFROAD_POWER_LIMIT_ENABLED, 0, 1),
+    EEPROM_FIELD (58, ui8_offroad_power_limit_div25, 1, EEPROM_FIELD_PROFILE, DEFAULT_VALUE_OFFROAD_POWER_LIMIT_DIV25, 4, 40),
+    EEPROM_FIELD (59, ui32_odometer_x10, 3, EEPROM_FIELD_JOURNAL, DEFAULT_VALUE_ODOMETER_X10, 0, 0xffffff),
+    EEPROM_FIELD (62, ui8_battery_voltage_filter_coefficient, 1, 0, DEFAULT_VALUE_BATTERY_VOLTAGE_FILTER_COEFFICIENT, 0, FILTER_COEFFICIENT_MAX),
+    EEPROM_FIELD (63, ui8_battery_current_filter_coefficient, 1, 0, DEFAULT_VALUE_BATTERY_CURRENT_FILTER_COEFFICIENT, 0, FILTER_COEFFICIENT_MAX),
+    EEPROM_FIELD (64, ui8_pedal_torque_filter_coefficient, 1, 0, DEFAULT_VALUE_PEDAL_TORQUE_FILTER_COEFFICIENT, 0, FILTER_COEFFICIENT_MAX),
+    EEPROM_FIELD (65, ui8_filter_fast_response, 1, 0, DEFAULT_VALUE_FILTER_FAST_RESPONSE, 0, 7),
+    EEPROM_FIELD (66, ui16_odometer_distance_x10, 2, EEPROM_FIELD_JOURNAL, DEFAULT_VALUE_TRIP, 0, 0xffff),
+    EEPROM_FIELD (68, ui32_trip_moving_time_seconds, 4, EEPROM_FIELD_JOURNAL, DEFAULT_VALUE_TRIP, 0, 0xffffffff),
+    EEPROM_FIELD (72, ui32_trip_total_time_seconds, 4, EEPROM_FIELD_JOURNAL, DEFAULT_VALUE_TRIP, 0, 0xffffffff),
+    EEPROM_FIELD (76, ui16_trip_max_speed_x10, 2, EEPROM_FIELD_JOURNAL, DEFAULT_VALUE_TRIP, 0, 0xffff),
+    EEPROM_FIELD (78, ui32_trip_energy_ws, 4, EEPROM_FIELD_JOURNAL, DEFAULT_VALUE_TRIP, 0, 0xffffffff),
+    EEPROM_FIELD (82, ui8_profile, 1, 0, DEFAULT_VALUE_PROFILE, 0, EEPROM_PROFILES - 1)
   };
 
-static void eeprom_write_array (uint8_t *array, uint8_t ui8_len);
-static void eeprom_read_values_to_variables (void);
-static void variables_to_array (uint8_t *ui8_array);
+#define EEPROM_SCHEMA_FIELDS (sizeof (eeprom_schema) / sizeof (struct_eeprom_field))
+
+// compile time checks, the array size is negative when they fail: one bitmap bit for each profile variable and
+// the values of all of them must fit on the profile record
+typedef uint8_t profile_bitmap_size_check [(PROFILE_FIELDS <= (PROFILE_BITMAP_SIZE * 8)) ? 1 : -1];
+typedef uint8_t profile_data_size_check [((PROFILE_OFFSET_DATA + PROFILE_DATA_SIZE) <= PROFILE_OFFSET_CRC) ? 1 : -1];
+
+// Journal
+//
+// The Wh offset, odometer and trip values change on every ride, so instead of always rewriting the same cells of the
+// variables stored at EEPROM_BASE_ADDRESS, each save writes a new record on the next of EEPROM_JOURNAL_SLOTS slots,
+// round-robin, which multiplies the endurance of these cells by the number of slots. Each record has a key,
+// a sequence number and a CRC16, and at startup the valid record with the highest sequence number is used.
+// The values of this variables stored at EEPROM_BASE_ADDRESS are kept as they are and are used only when
+// there is no valid record, like after updating from a previous firmware version.
+//
+// When the power fails, the record goes to the first slot of the next 128 bytes block with one block program operation,
+// instead of one operation for each word and byte of the record. That block is kept erased in background, so it is
+// written with fast programming (about 3 ms, no erase) or, if the erase was not done yet, with standard programming
+// (about 6 ms, erase + write) - datasheet times, not measured on the LCD.
+static uint8_t ui8_journal_record [JOURNAL_RECORD_SIZE];
+static uint8_t ui8_journal_staged_record [JOURNAL_RECORD_SIZE];
+static uint8_t ui8_journal_slot;
+static uint32_t ui32_journal_sequence;
+static uint8_t ui8_journal_staged;
+static uint8_t ui8_journal_queued;
+static uint8_t ui8_journal_erase_queued;
+
+static uint16_t ui16_eeprom_write_time;
+static uint16_t ui16_eeprom_write_start_time;
+static uint8_t ui8_eeprom_write_requested;
+static uint8_t ui8_eeprom_write_aborted;
+
+// image in use: the next save goes to the other one
+static uint16_t ui16_image_address;
+static uint16_t ui16_image_data_address;
+static uint8_t ui8_image_version;
+static uint8_t ui8_image_length;
+static uint8_t ui8_image_sequence;
+static uint8_t ui8_image [EEPROM_IMAGE_SIZE];
+
+// Profiles
+//
+// Profile 0 values are the ones of the configuration image. The configuration image always keeps the profile 0 values
+// of the EEPROM_FIELD_PROFILE variables, and the slot of each other profile keeps only the values that are different,
+// so each profile costs a few bytes and switching is just loading the profile 0 values and applying the differences.
+// Each save writes the record with the next sequence number on the slot not in use, so if power fails while writing,
+// the record in use is still valid, and the valid record with the newest sequence number is used.
+static uint8_t ui8_profile_record [EEPROM_PROFILE_SLOT_SIZE];
+
+// Background writer
+//
+// Each program operation takes some milliseconds, during which the CPU would be blocked waiting. Instead, the data to
+// write is queued and clock_eeprom () programs one word or byte (or erases one block) when the previous operation
+// ended, so the main loop keeps running while the data EEPROM is being programmed (read while write).
+static struct_eeprom_write_job eeprom_write_queue [EEPROM_WRITE_QUEUE_SIZE];
+static uint8_t ui8_write_queue_head;
+static uint8_t ui8_write_queue_count;
+static uint8_t ui8_write_index;
+static uint8_t ui8_write_program_operation;
+
+static void eeprom_write_array (uint16_t ui16_address, uint8_t *array, uint8_t ui8_len);
+static uint8_t eeprom_read_values_to_variables (void);
+static uint32_t eeprom_field_read (const struct_eeprom_field *p_field);
+static uint32_t eeprom_variable_get (uint8_t *p_variables, const struct_eeprom_field *p_field);
+static void eeprom_variable_set (uint8_t *p_variables, const struct_eeprom_field *p_field, uint32_t ui32_value);
+static uint8_t image_check (uint16_t ui16_address);
+static void image_write (void);
+static void image_write_done (void);
+static void eeprom_write_queue_add (uint16_t ui16_address, uint8_t *array, uint8_t ui8_len, void (*p_done) (void));
+static void eeprom_write_abort (void);
+static void journal_load (void);
+static void journal_write (void);
+static void journal_erase (void);
+static void journal_erase_next_block (void);
+static uint8_t eeprom_changed (uint16_t ui16_address, uint8_t *array, uint8_t ui8_len);
+static uint16_t profile_slot_address (uint8_t ui8_profile, uint8_t ui8_slot);
+static uint16_t profile_record_load (uint8_t ui8_profile, uint8_t *ui8_record);
+static void profile_apply (uint8_t ui8_profile);
+static void profile_write (void);
 
 void eeprom_init (void)
 {
-  uint8_t ui8_data;
+  uint8_t ui8_image_a_valid;
+  uint8_t ui8_image_b_valid;
+
+  ui8_image_a_valid = image_check (EEPROM_IMAGE_A_ADDRESS);
+  ui8_image_b_valid = image_check (EEPROM_IMAGE_B_ADDRESS);
+
+  // both valid: use the one with the newest sequence number
+  if (ui8_image_a_valid && ui8_image_b_valid)
+  {
+    if (((uint8_t) (FLASH_ReadByte (EEPROM_IMAGE_B_ADDRESS + EEPROM_IMAGE_OFFSET_SEQUENCE) -
+        FLASH_ReadByte (EEPROM_IMAGE_A_ADDRESS + EEPROM_IMAGE_OFFSET_SEQUENCE))) < 128)
+    {
+      ui8_image_a_valid = 0;
+    }
+    else
+    {
+      ui8_image_b_valid = 0;
+    }
+  }
+
+  if (ui8_image_a_valid || ui8_image_b_valid)
+  {
+    ui16_image_address = ui8_image_a_valid ? EEPROM_IMAGE_A_ADDRESS : EEPROM_IMAGE_B_ADDRESS;
+    ui16_image_data_address = ui16_image_address + EEPROM_IMAGE_OFFSET_DATA;
+    ui8_image_version = FLASH_ReadByte (ui16_image_address + EEPROM_IMAGE_OFFSET_VERSION);
+    ui8_image_length = FLASH_ReadByte (ui16_image_address + EEPROM_IMAGE_OFFSET_LENGTH);
+    ui8_image_sequence = FLASH_ReadByte (ui16_image_address + EEPROM_IMAGE_OFFSET_SEQUENCE);
+    return;
+  }
+
+  // no valid image: data written by previous firmware versions is used as version 0 image,
+  // on image A address, so the new image will be written on image B and this data will be kept until it is valid
+  ui16_image_address = EEPROM_IMAGE_A_ADDRESS;
+  ui16_image_data_address = EEPROM_BASE_ADDRESS;
+  ui8_image_version = 0;
+  ui8_image_sequence = 0;
 
-  // start by reading address 0 and see if value is different from our key,
-  // if so mean that eeprom memory is clean and we need to populate: should happen after erasing the microcontroller
-  ui8_data = FLASH_ReadByte (ADDRESS_KEY);
-  if (ui8_data != KEY) // verify if our key exist
+  if (FLASH_ReadByte (EEPROM_BASE_ADDRESS) == EEPROM_LEGACY_KEY)
   {
-    eeprom_write_array (array_default_values, ((uint32_t) EEPROM_BYTES_STORED));
+    // this version had no journal
+    ui8_image_length = EEPROM_LEGACY_BYTES_STORED;
+    journal_erase ();
+  }
+  // clean EEPROM memory, should happen after erasing the microcontroller: all variables will get the default values
+  else
+  {
+    ui16_image_address = EEPROM_IMAGE_B_ADDRESS;
+    ui8_image_length = 0;
+    journal_erase ();
   }
 }
 
 void eeprom_init_variables (void)
 {
-  struct_configuration_variables *p_configuration_variables;
-  p_configuration_variables = get_configuration_variables ();
+  // values out of the valid range or not stored on the image were replaced by the default ones,
+  // write them so the EEPROM is repaired; images of previous versions are also written again on the new version
+  if ((eeprom_read_values_to_variables ()) ||
+      (ui8_image_version < EEPROM_IMAGE_VERSION))
+  {
+    image_write ();
+  }
 
-  eeprom_read_values_to_variables ();
-
-//  // now verify if any EEPROM saved value is out of valid range and if so,
-//  // write correct ones and read again
-//  if ((p_configuration_variables->ui8_number_of_assist_levels < 1) ||
-//      (p_configuration_variables->ui8_number_of_assist_levels > 9) ||
-//      (p_configuration_variables->ui16_wheel_perimeter > 3000) ||
-//      (p_configuration_variables->ui16_wheel_perimeter < 750) ||
-//      (p_configuration_variables->ui8_wheel_max_speed > 99) ||
-//      (p_configuration_variables->ui8_units_type > 1) ||
-//      (p_configuration_variables->ui32_wh_x10_offset > 99900) ||
-//      (p_configuration_variables->ui32_wh_x10_100_percent > 99900) ||
-//      (p_configuration_variables->ui8_show_numeric_battery_soc > 2) ||
-//      (p_configuration_variables->ui8_odometer_field_state > 4) ||
-//      (p_configuration_variables->ui8_battery_max_current > 100) ||
-//      (p_configuration_variables->ui8_target_max_battery_power_div10 > 195) ||
-//      (p_configuration_variables->ui8_startup_motor_power_boost_state > 3) ||
-//      (p_configuration_variables->ui8_battery_cells_number > 15) ||
-//      (p_configuration_variables->ui8_battery_cells_number < 6) ||
-//      (p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 > 630) ||
-//      (p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 < 160) ||
-//      (p_configuration_variables->ui8_cruise_control > 1) ||
-//      (p_configuration_variables->ui8_motor_voltage_type > 1) ||
-//      (p_configuration_variables->ui8_motor_temperature_min_value_to_limit < 124) ||
-//      (p_configuration_variables->ui8_motor_temperature_max_value_to_limit < 124) ||
-//      (p_configuration_variables->ui8_motor_assistance_startup_without_pedal_rotation > 1))
-//  {
-//    eeprom_write_array (array_default_values);
-//    eeprom_read_values_to_variables ();
-//  }
-}
-
-static void eeprom_read_values_to_variables (void)
-{
-  uint8_t ui8_temp;
-  uint16_t ui16_temp;
-  uint32_t ui32_temp;
-  uint8_t ui8_index;
+  // the image has the profile 0 values, apply the ones of the profile in use
+  profile_apply (get_configuration_variables ()->ui8_profile);
 
-  struct_configuration_variables *p_configuration_variables;
-  p_configuration_variables = get_configuration_variables ();
+  journal_load ();
+  lcd_configuration_variables_changed ();
+}
 
-  p_configuration_variables->ui8_assist_level = FLASH_ReadByte (ADDRESS_ASSIST_LEVEL);
+static uint8_t image_check (uint16_t ui16_address)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_length;
+  uint16_t ui16_crc = 0xffff;
 
-  ui16_temp = FLASH_ReadByte (ADDRESS_WHEEL_PERIMETER_0);
-  ui8_temp = FLASH_ReadByte (ADDRESS_WHEEL_PERIMETER_1);
-  ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
-  p_configuration_variables->ui16_wheel_perimeter = ui16_temp;
+  if (FLASH_ReadByte (ui16_address + EEPROM_IMAGE_OFFSET_MAGIC) != EEPROM_IMAGE_MAGIC) { return 0; }
+  if (FLASH_ReadByte (ui16_address + EEPROM_IMAGE_OFFSET_VERSION) != EEPROM_IMAGE_VERSION) { return 0; }
 
-  p_configuration_variables->ui8_wheel_max_speed = FLASH_ReadByte (ADDRESS_MAX_WHEEL_SPEED);
-  p_configuration_variables->ui8_units_type = FLASH_ReadByte (ADDRESS_UNITS_TYPE);
+  ui8_length = FLASH_ReadByte (ui16_address + EEPROM_IMAGE_OFFSET_LENGTH);
+  if (ui8_length > EEPROM_IMAGE_MAX_BYTES_STORED) { return 0; }
 
-  ui32_temp = FLASH_ReadByte (ADDRESS_HW_X10_OFFSET_0);
-  ui8_temp = FLASH_ReadByte (ADDRESS_HW_X10_OFFSET_1);
-  ui32_temp += (((uint32_t) ui8_temp << 8) & 0xff00);
-  ui8_temp = FLASH_ReadByte (ADDRESS_HW_X10_OFFSET_2);
-  ui32_temp += (((uint32_t) ui8_temp << 16) & 0xff0000);
-  ui8_temp = FLASH_ReadByte (ADDRESS_HW_X10_OFFSET_3);
-  ui32_temp += (((uint32_t) ui8_temp << 24) & 0xff000000);
-  p_configuration_variables->ui32_wh_x10_offset = ui32_temp;
+  for (ui8_i = 0; ui8_i < EEPROM_IMAGE_OFFSET_CRC; ui8_i++)
+  {
+    crc16 (FLASH_ReadByte (ui16_address + ui8_i), &ui16_crc);
+  }
+  for (ui8_i = 0; ui8_i < ui8_length; ui8_i++)
+  {
+    crc16 (FLASH_ReadByte (ui16_address + EEPROM_IMAGE_OFFSET_DATA + ui8_i), &ui16_crc);
+  }
 
-  ui32_temp = FLASH_ReadByte (ADDRESS_HW_X10_100_PERCENT_OFFSET_0);
-  ui8_temp = FLASH_ReadByte (ADDRESS_HW_X10_100_PERCENT_OFFSET_1);
-  ui32_temp += (((uint32_t) ui8_temp << 8) & 0xff00);
-  ui8_temp = FLASH_ReadByte (ADDRESS_HW_X10_100_PERCENT_OFFSET_2);
-  ui32_temp += (((uint32_t) ui8_temp << 16) & 0xff0000);
-  ui8_temp = FLASH_ReadByte (ADDRESS_HW_X10_100_PERCENT_OFFSET_3);
-  ui32_temp += (((uint32_t) ui8_temp << 24) & 0xff000000);
-  p_configuration_variables->ui32_wh_x10_100_percent = ui32_temp;
+  return ((FLASH_ReadByte (ui16_address + EEPROM_IMAGE_OFFSET_CRC) == (uint8_t) (ui16_crc & 255)) &&
+      (FLASH_ReadByte (ui16_address + EEPROM_IMAGE_OFFSET_CRC + 1) == (uint8_t) (ui16_crc >> 8)));
+}
 
-  p_configuration_variables->ui8_show_numeric_battery_soc = FLASH_ReadByte (ADDRESS_SHOW_NUMERIC_BATTERY_SOC);
-  p_configuration_variables->ui8_odometer_field_state = FLASH_ReadByte (ADDRESS_ODOMETER_FIELD_STATE);
-  p_configuration_variables->ui8_battery_max_current = FLASH_ReadByte (ADDRESS_BATTERY_MAX_CURRENT);
-  p_configuration_variables->ui8_target_max_battery_power = FLASH_ReadByte (ADDRESS_TARGET_MAX_BATTERY_POWER);
-  p_configuration_variables->ui8_battery_cells_number = FLASH_ReadByte (ADDRESS_BATTERY_CELLS_NUMBER);
+static void image_write (void)
+{
+  uint8_t ui8_i;
+  uint16_t ui16_crc = 0xffff;
+  const struct_eeprom_field *p_field;
 
-  ui16_temp = FLASH_ReadByte (ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0);
-  ui8_temp = FLASH_ReadByte (ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1);
-  ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
-  p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 = ui16_temp;
+  // the data is the memory image of the configuration variables
+  memcpy (&ui8_image [EEPROM_IMAGE_OFFSET_DATA], get_configuration_variables (), EEPROM_BYTES_STORED);
 
-  p_configuration_variables->ui8_pas_max_cadence = FLASH_ReadByte (ADDRESS_PAS_MAX_CADENCE);
+  // Wh, odometer and trip values are saved on the journal, keep their previous values here,
+  // the same for the profile 0 values when other profile is in use, its values are saved on the profile slot
+  for (ui8_i = 0; ui8_i < EEPROM_SCHEMA_FIELDS; ui8_i++)
+  {
+    p_field = &eeprom_schema [ui8_i];
+    if ((p_field->ui8_flags & EEPROM_FIELD_JOURNAL) ||
+        ((p_field->ui8_flags & EEPROM_FIELD_PROFILE) && get_configuration_variables ()->ui8_profile))
+    {
+      eeprom_variable_set (&ui8_image [EEPROM_IMAGE_OFFSET_DATA], p_field, eeprom_field_read (p_field));
+    }
+  }
 
-  ui8_temp = FLASH_ReadByte (ADDRESS_CONFIG_0);
-  p_configuration_variables->ui8_motor_voltage_type = ui8_temp & 1;
-  p_configuration_variables->ui8_motor_assistance_startup_without_pedal_rotation = (ui8_temp & 2) >> 1;
-  p_configuration_variables->ui8_throttle_adc_measures_motor_temperature = (ui8_temp & 4) >> 2;
-  p_configuration_variables->ui8_temperature_field_config = (ui8_temp & 24) >> 3;
+  ui8_image [EEPROM_IMAGE_OFFSET_MAGIC] = EEPROM_IMAGE_MAGIC;
+  ui8_image [EEPROM_IMAGE_OFFSET_VERSION] = EEPROM_IMAGE_VERSION;
+  ui8_image [EEPROM_IMAGE_OFFSET_LENGTH] = EEPROM_BYTES_STORED;
+  ui8_image [EEPROM_IMAGE_OFFSET_SEQUENCE] = ui8_image_sequence + 1;
 
-  p_configuration_variables->ui8_number_of_assist_levels = FLASH_ReadByte (ADDRESS_NUMBER_OF_ASSIST_LEVELS);
-  for (ui8_index = 0; ui8_index < 9; ui8_index++)
+  for (ui8_i = 0; ui8_i < EEPROM_IMAGE_OFFSET_CRC; ui8_i++)
+  {
+    crc16 (ui8_image [ui8_i], &ui16_crc);
+  }
+  for (ui8_i = EEPROM_IMAGE_OFFSET_DATA; ui8_i < EEPROM_IMAGE_SIZE; ui8_i++)
   {
-    p_configuration_variables->ui8_assist_level_power [ui8_index] = FLASH_ReadByte (ADDRESS_ASSIST_LEVEL_FACTOR_1 + ui8_index);
+    crc16 (ui8_image [ui8_i], &ui16_crc);
   }
+  ui8_image [EEPROM_IMAGE_OFFSET_CRC] = ui16_crc & 255;
+  ui8_image [EEPROM_IMAGE_OFFSET_CRC + 1] = ui16_crc >> 8;
+
+  // write on the image not in use, the image in use is kept until the new one is fully written
+  eeprom_write_queue_add ((ui16_image_address == EEPROM_IMAGE_A_ADDRESS) ? EEPROM_IMAGE_B_ADDRESS : EEPROM_IMAGE_A_ADDRESS,
+      ui8_image, EEPROM_IMAGE_SIZE, image_write_done);
+}
+
+static void image_write_done (void)
+{
+  // the new image becomes the image in use
+  ui16_image_address = (ui16_image_address == EEPROM_IMAGE_A_ADDRESS) ? EEPROM_IMAGE_B_ADDRESS : EEPROM_IMAGE_A_ADDRESS;
+  ui16_image_data_address = ui16_image_address + EEPROM_IMAGE_OFFSET_DATA;
+  ui8_image_version = EEPROM_IMAGE_VERSION;
+  ui8_image_length = EEPROM_BYTES_STORED;
+  ui8_image_sequence++;
+
+  // time of this save, in TIM3 ticks (1.024 ms)
+  ui16_eeprom_write_time = TIM3_GetCounter () - ui16_eeprom_write_start_time;
 
-  p_configuration_variables->ui8_startup_motor_power_boost_state = FLASH_ReadByte (ADDRESS_STARTUP_MOTOR_POWER_BOOST_STATE);
-  p_configuration_variables->ui8_startup_motor_power_boost_time = FLASH_ReadByte (ADDRESS_STARTUP_MOTOR_POWER_BOOST_TIME);
-  for (ui8_index = 0; ui8_index < 9; ui8_index++)
+  // variables changed again while this save was being written
+  if (ui8_eeprom_write_requested)
   {
-    p_configuration_variables->ui8_startup_motor_power_boost [ui8_index] = FLASH_ReadByte (ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_1 + ui8_index);
+    ui8_eeprom_write_requested = 0;
+    eeprom_write_variables ();
   }
+}
+
+static uint32_t eeprom_variable_get (uint8_t *p_variables, const struct_eeprom_field *p_field)
+{
+  uint8_t *p_variable = p_variables + p_field->ui8_variable_offset;
+
+  switch (p_field->ui8_variable_size)
+  {
+    case 1:
+      return *p_variable;
+
+    case 2:
+      return *((uint16_t *) p_variable);
+
+    default:
+      return *((uint32_t *) p_variable);
+  }
+}
+
+static void eeprom_variable_set (uint8_t *p_variables, const struct_eeprom_field *p_field, uint32_t ui32_value)
+{
+  uint8_t *p_variable = p_variables + p_field->ui8_variable_offset;
 
-  p_configuration_variables->ui8_startup_motor_power_boost_fade_time = FLASH_ReadByte (ADDRESS_STARTUP_MOTOR_POWER_BOOST_FADE_TIME);
+  switch (p_field->ui8_variable_size)
+  {
+    case 1:
+      *p_variable = (uint8_t) ui32_value;
+    break;
+
+    case 2:
+      *((uint16_t *) p_variable) = (uint16_t) ui32_value;
+    break;
+
+    default:
+      *((uint32_t *) p_variable) = ui32_value;
+    break;
+  }
+}
+
+static uint8_t eeprom_field_stored (const struct_eeprom_field *p_field)
+{
+  if (ui8_image_version == EEPROM_IMAGE_VERSION)
+  {
+    return ((p_field->ui8_variable_offset + p_field->ui8_variable_size) <= ui8_image_length);
+  }
+
+  return ((p_field->ui8_address + p_field->ui8_eeprom_size) <= ui8_image_length);
+}
 
-  p_configuration_variables->ui8_motor_temperature_min_value_to_limit = FLASH_ReadByte (ADDRESS_MOTOR_TEMPERATURE_MIN_VALUE_LIMIT);
-  p_configuration_variables->ui8_motor_temperature_max_value_to_limit = FLASH_ReadByte (ADDRESS_MOTOR_TEMPERATURE_MAX_VALUE_LIMIT);
+// reads the value from the image in use, fields not stored on older images get the default value
+static uint32_t eeprom_field_read (const struct_eeprom_field *p_field)
+{
+  uint8_t ui8_i;
+  uint32_t ui32_value = 0;
+
+  if (eeprom_field_stored (p_field) == 0)
+  {
+    return p_field->ui16_default;
+  }
+
+  // data EEPROM is memory mapped, version 2 images have the same memory layout as the variables
+  if (ui8_image_version == EEPROM_IMAGE_VERSION)
+  {
+    return eeprom_variable_get ((uint8_t *) ui16_image_data_address, p_field);
+  }
+
+  // version 0: little endian values and bits packed on bytes, at the schema address
+  for (ui8_i = p_field->ui8_eeprom_size; ui8_i > 0; ui8_i--)
+  {
+    ui32_value = (ui32_value << 8) | FLASH_ReadByte (ui16_image_data_address + p_field->ui8_address + ui8_i - 1);
+  }
+
+  if (p_field->ui8_bit_mask)
+  {
+    ui32_value = (ui32_value >> p_field->ui8_bit_shift) & p_field->ui8_bit_mask;
+  }
+
+  return ui32_value;
+}
+
+// returns the number of values that were out of the valid range or not stored on the image
+static uint8_t eeprom_read_values_to_variables (void)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_invalid = 0;
+  uint32_t ui32_value;
+  uint8_t *p_variables = (uint8_t *) get_configuration_variables ();
+  const struct_eeprom_field *p_field;
+
+  // version 2 images are copied as they are, only the range validation is left. Images of a newer firmware can have
+  // more variables at the end, only the ones this firmware knows are copied
+  if (ui8_image_version == EEPROM_IMAGE_VERSION)
+  {
+    memcpy (p_variables, (uint8_t *) ui16_image_data_address,
+        (ui8_image_length < EEPROM_BYTES_STORED) ? ui8_image_length : EEPROM_BYTES_STORED);
+  }
 
-  ui16_temp = FLASH_ReadByte (ADDRESS_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_0);
-  ui8_temp = FLASH_ReadByte (ADDRESS_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_1);
-  ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
-  p_configuration_variables->ui16_battery_voltage_reset_wh_counter_x10 = ui16_temp;
+  for (ui8_i = 0; ui8_i < EEPROM_SCHEMA_FIELDS; ui8_i++)
+  {
+    p_field = &eeprom_schema [ui8_i];
 
-  p_configuration_variables->ui8_lcd_power_off_time_minutes = FLASH_ReadByte (ADDRESS_LCD_POWER_OFF_TIME);
-  p_configuration_variables->ui8_lcd_backlight_on_brightness = FLASH_ReadByte (ADDRESS_LCD_BACKLIGHT_ON_BRIGHTNESS);
-  p_configuration_variables->ui8_lcd_backlight_off_brightness = FLASH_ReadByte (ADDRESS_LCD_BACKLIGHT_OFF_BRIGHTNESS);
+    if (ui8_image_version == EEPROM_IMAGE_VERSION)
+    {
+      ui32_value = eeprom_variable_get (p_variables, p_field);
+    }
+    else
+    {
+      ui32_value = eeprom_field_read (p_field);
+    }
 
-  ui16_temp = FLASH_ReadByte (ADDRESS_BATTERY_PACK_RESISTANCE_0);
-  ui8_temp = FLASH_ReadByte (ADDRESS_BATTERY_PACK_RESISTANCE_1);
-  ui16_temp += (((uint16_t) ui8_temp << 8) & 0xff00);
-  p_configuration_variables->ui16_battery_pack_resistance_x1000 = ui16_temp;
+    if ((eeprom_field_stored (p_field) == 0) ||
+        (ui32_value < p_field->ui16_min) || (ui32_value > p_field->ui32_max))
+    {
+      ui32_value = p_field->ui16_default;
+      ui8_invalid++;
+    }
 
-  p_configuration_variables->ui8_offroad_func_enabled = FLASH_ReadByte (ADDRESS_DEFAULT_VALUE_OFFROAD_FUNC_ENABLED);
-  p_configuration_variables->ui8_offroad_enabled_on_startup = FLASH_ReadByte (ADDRESS_DEFAULT_VALUE_OFFROAD_MODE_ENABLED_ON_STARTUP);
-  p_configuration_variables->ui8_offroad_speed_limit = FLASH_ReadByte (ADDRESS_DEFAULT_VALUE_OFFROAD_SPEED_LIMIT);
-  p_configuration_variables->ui8_offroad_power_limit_enabled = FLASH_ReadByte (ADDRESS_DEFAULT_VALUE_OFFROAD_POWER_LIMIT_ENABLED);
-  p_configuration_variables->ui8_offroad_power_limit_div25 = FLASH_ReadByte (ADDRESS_DEFAULT_VALUE_OFFROAD_POWER_LIMIT_DIV25);
+    eeprom_variable_set (p_variables, p_field, ui32_value);
+  }
 
-  ui32_temp = FLASH_ReadByte (ADDRESS_ODOMETER_X10_0);
-  ui8_temp = FLASH_ReadByte (ADDRESS_ODOMETER_X10_1);
-  ui32_temp += (((uint32_t) ui8_temp << 8) & 0xff00);
-  ui8_temp = FLASH_ReadByte (ADDRESS_ODOMETER_X10_2);
-  ui32_temp += (((uint32_t) ui8_temp << 16) & 0xff0000);
-  p_configuration_variables->ui32_odometer_x10 = ui32_temp;
+  return ui8_invalid;
 }
 
+// queues the save of the variables, written in background by clock_eeprom ()
 void eeprom_write_variables (void)
 {
-  uint8_t array_variables [EEPROM_BYTES_STORED];
-  variables_to_array (array_variables);
-  eeprom_write_array (array_variables, ((uint8_t) EEPROM_BYTES_STORED));
+  // values derived from the configuration variables must be calculated again
+  lcd_configuration_variables_changed ();
+
+  // the queued data must not change while being written, save again when the current save ends
+  if (ui8_write_queue_count)
+  {
+    ui8_eeprom_write_requested = 1;
+    return;
+  }
+
+  ui16_eeprom_write_start_time = TIM3_GetCounter ();
+
+  // Wh, odometer and trip values go to the journal
+  journal_write ();
+  // must be before image_write (), as the profile 0 values are read from the image in use
+  profile_write ();
+  image_write ();
+}
+
+// blocks until all the queued data is written, like before powering off
+void eeprom_write_flush (void)
+{
+  while (ui8_write_queue_count)
+  {
+    clock_eeprom ();
+  }
+}
+
+// should be called every 1ms
+void clock_eeprom (void)
+{
+  struct_eeprom_write_job *p_job;
+  uint16_t ui16_address;
+  uint32_t ui32_word;
+
+  if (ui8_write_queue_count == 0) { return; }
+
+  // wait for the end of the previous program operation
+  if (ui8_write_program_operation)
+  {
+    if ((FLASH->IAPSR & (FLASH_IAPSR_EOP | FLASH_IAPSR_WR_PG_DIS)) == 0) { return; }
+    ui8_write_program_operation = 0;
+  }
+
+  p_job = &eeprom_write_queue [ui8_write_queue_head];
+
+  // job without data: the block is erased with one program operation
+  if ((p_job->p_data == 0) && (ui8_write_index == 0))
+  {
+    FLASH_EraseBlock ((p_job->ui16_address - FLASH_DATA_START_PHYSICAL_ADDRESS) / FLASH_BLOCK_SIZE, FLASH_MEMTYPE_DATA);
+    ui8_write_index = p_job->ui8_len;
+    ui8_write_program_operation = 1;
+    return;
+  }
+
+  // unchanged data is skipped, the first changed word or byte is programmed
+  while (ui8_write_index < p_job->ui8_len)
+  {
+    ui16_address = p_job->ui16_address + ui8_write_index;
+
+    if (((ui16_address & 3) == 0) &&
+        ((uint8_t) (p_job->ui8_len - ui8_write_index) >= 4))
+    {
+      if (eeprom_changed (ui16_address, &p_job->p_data [ui8_write_index], 4))
+      {
+        // FLASH_ProgramWord () writes the bytes of the word as they are on memory
+        memcpy (&ui32_word, &p_job->p_data [ui8_write_index], 4);
+        FLASH_ProgramWord ((uint32_t) ui16_address, ui32_word);
+        ui8_write_program_operation = 1;
+      }
+
+      ui8_write_index += 4;
+    }
+    else
+    {
+      if (FLASH_ReadByte ((uint32_t) ui16_address) != p_job->p_data [ui8_write_index])
+      {
+        FLASH_ProgramByte ((uint32_t) ui16_address, p_job->p_data [ui8_write_index]);
+        ui8_write_program_operation = 1;
+      }
+
+      ui8_write_index++;
+    }
+
+    if (ui8_write_program_operation) { return; }
+  }
+
+  // job done, the next job may be added by the callback
+  ui8_write_index = 0;
+  ui8_write_queue_head = (ui8_write_queue_head + 1) % EEPROM_WRITE_QUEUE_SIZE;
+  ui8_write_queue_count--;
+  if (ui8_write_queue_count == 0)
+  {
+    FLASH_Lock (FLASH_MEMTYPE_DATA);
+  }
+
+  if (p_job->p_done)
+  {
+    p_job->p_done ();
+  }
+}
+
+static void eeprom_write_queue_add (uint16_t ui16_address, uint8_t *array, uint8_t ui8_len, void (*p_done) (void))
+{
+  struct_eeprom_write_job *p_job;
+
+  if (ui8_write_queue_count >= EEPROM_WRITE_QUEUE_SIZE)
+  {
+    eeprom_write_flush ();
+  }
+
+  p_job = &eeprom_write_queue [(ui8_write_queue_head + ui8_write_queue_count) % EEPROM_WRITE_QUEUE_SIZE];
+  p_job->ui16_address = ui16_address;
+  p_job->p_data = array;
+  p_job->ui8_len = ui8_len;
+  p_job->p_done = p_done;
+  ui8_write_queue_count++;
+
+  if (FLASH_GetFlagStatus(FLASH_FLAG_DUL) == 0)
+  {
+    FLASH_Unlock (FLASH_MEMTYPE_DATA);
+  }
+}
+
+// drops the queued data, data partially written will have a wrong CRC and will not be used,
+// the save is done again by eeprom_write_retry () if the power did not fail after all
+static void eeprom_write_abort (void)
+{
+  if (ui8_write_program_operation)
+  {
+    FLASH_WaitForLastOperation (FLASH_MEMTYPE_DATA);
+    ui8_write_program_operation = 0;
+  }
+
+  if (ui8_write_queue_count || ui8_eeprom_write_requested) { ui8_eeprom_write_aborted = 1; }
+
+  ui8_write_queue_count = 0;
+  ui8_write_index = 0;
+  ui8_eeprom_write_requested = 0;
+}
+
+// the voltage recovered after a power fail detection: saves again the variables if the save was dropped
+void eeprom_write_retry (void)
+{
+  if (ui8_eeprom_write_aborted)
+  {
+    ui8_eeprom_write_aborted = 0;
+    eeprom_write_variables ();
+  }
+}
+
+static uint8_t eeprom_changed (uint16_t ui16_address, uint8_t *array, uint8_t ui8_len)
+{
+  uint8_t ui8_i;
+
+  for (ui8_i = 0; ui8_i < ui8_len; ui8_i++)
+  {
+    if (FLASH_ReadByte (((uint32_t) ui16_address) + ((uint32_t) ui8_i)) != array [ui8_i]) { return 1; }
+  }
+
+  return 0;
+}
+
+// Each program operation (byte or word) wears the EEPROM and takes some milliseconds (erase + write),
+// so unchanged data is skipped and the data is written with the least program operations:
+// - full 4 bytes aligned words with word programming;
+// - the other bytes with byte programming.
+// No write is a full 128 bytes block (the image is the biggest one), so there is no block programming here, only for
+// the power fail journal record, see journal_write_block ().
+static void eeprom_write_array (uint16_t ui16_address, uint8_t *array, uint8_t ui8_len)
+{
+  uint8_t ui8_i = 0;
+  uint16_t ui16_byte_address;
+  uint32_t ui32_word;
+
+  if (FLASH_GetFlagStatus(FLASH_FLAG_DUL) == 0)
+  {
+    FLASH_Unlock (FLASH_MEMTYPE_DATA);
+  }
+
+  while (ui8_i < ui8_len)
+  {
+    ui16_byte_address = ui16_address + ui8_i;
+
+    if (((ui16_byte_address & 3) == 0) &&
+        ((uint8_t) (ui8_len - ui8_i) >= 4))
+    {
+      if (eeprom_changed (ui16_byte_address, &array [ui8_i], 4))
+      {
+        // FLASH_ProgramWord () writes the bytes of the word as they are on memory
+        memcpy (&ui32_word, &array [ui8_i], 4);
+        FLASH_ProgramWord ((uint32_t) ui16_byte_address, ui32_word);
+      }
+
+      ui8_i += 4;
+      continue;
+    }
+
+    if (FLASH_ReadByte ((uint32_t) ui16_byte_address) != array [ui8_i])
+    {
+      FLASH_ProgramByte ((uint32_t) ui16_byte_address, array [ui8_i]);
+    }
+
+    ui8_i++;
+  }
+
+  // wait for the last program operation
+  FLASH_WaitForLastOperation (FLASH_MEMTYPE_DATA);
+
+  FLASH_Lock (FLASH_MEMTYPE_DATA);
+}
+
+uint16_t eeprom_get_write_time (void)
+{
+  return ui16_eeprom_write_time;
+}
+
+void eeprom_erase_key_value (void)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_magic = 0;
+
+  eeprom_write_flush ();
+
+  // invalidate both images, on next startup the default values will be used
+  eeprom_write_array (EEPROM_IMAGE_A_ADDRESS + EEPROM_IMAGE_OFFSET_MAGIC, &ui8_magic, 1);
+  eeprom_write_array (EEPROM_IMAGE_B_ADDRESS + EEPROM_IMAGE_OFFSET_MAGIC, &ui8_magic, 1);
+
+  // the profiles values are differences to the profile 0 values, invalidate them too
+  for (ui8_i = 1; ui8_i < EEPROM_PROFILES; ui8_i++)
+  {
+    eeprom_write_array (profile_slot_address (ui8_i, 0) + PROFILE_OFFSET_KEY, &ui8_magic, 1);
+    eeprom_write_array (profile_slot_address (ui8_i, 1) + PROFILE_OFFSET_KEY, &ui8_magic, 1);
+  }
+}
+
+// slot 0 is the slot A of the profile and slot 1 the slot B
+static uint16_t profile_slot_address (uint8_t ui8_profile, uint8_t ui8_slot)
+{
+  return EEPROM_PROFILES_BASE_ADDRESS + (((uint16_t) (((ui8_profile - 1) << 1) + ui8_slot)) * EEPROM_PROFILE_SLOT_SIZE);
+}
+
+static void profile_crc (uint8_t *ui8_record)
+{
+  uint8_t ui8_i;
+  uint16_t ui16_crc = 0xffff;
+
+  for (ui8_i = 0; ui8_i < PROFILE_OFFSET_CRC; ui8_i++)
+  {
+    crc16 (ui8_record [ui8_i], &ui16_crc);
+  }
+  ui8_record [PROFILE_OFFSET_CRC] = ui16_crc & 255;
+  ui8_record [PROFILE_OFFSET_CRC + 1] = ui16_crc >> 8;
+}
+
+// reads the record on the slot to ui8_record, returns 1 if it is valid
+static uint8_t profile_record_read (uint16_t ui16_address, uint8_t *ui8_record)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_crc_0;
+  uint8_t ui8_crc_1;
+
+  for (ui8_i = 0; ui8_i < EEPROM_PROFILE_SLOT_SIZE; ui8_i++)
+  {
+    ui8_record [ui8_i] = FLASH_ReadByte (ui16_address + ui8_i);
+  }
+
+  if (ui8_record [PROFILE_OFFSET_KEY] != PROFILE_KEY) { return 0; }
+
+  ui8_crc_0 = ui8_record [PROFILE_OFFSET_CRC];
+  ui8_crc_1 = ui8_record [PROFILE_OFFSET_CRC + 1];
+  profile_crc (ui8_record);
+
+  return (ui8_record [PROFILE_OFFSET_CRC] == ui8_crc_0) && (ui8_record [PROFILE_OFFSET_CRC + 1] == ui8_crc_1);
+}
+
+// reads the record in use of the profile to ui8_record: the valid one of slots A and B or the newest if both are
+// valid, like after a power fail right after the write. Returns its address, 0 if the profile was never saved.
+static uint16_t profile_record_load (uint8_t ui8_profile, uint8_t *ui8_record)
+{
+  uint16_t ui16_address_a = profile_slot_address (ui8_profile, 0);
+  uint16_t ui16_address_b = profile_slot_address (ui8_profile, 1);
+  uint8_t ui8_sequence_a;
+
+  if (profile_record_read (ui16_address_a, ui8_record))
+  {
+    ui8_sequence_a = ui8_record [PROFILE_OFFSET_SEQUENCE];
+    if (profile_record_read (ui16_address_b, ui8_record) &&
+        (((uint8_t) (ui8_record [PROFILE_OFFSET_SEQUENCE] - ui8_sequence_a)) < 128))
+    {
+      return ui16_address_b;
+    }
+
+    profile_record_read (ui16_address_a, ui8_record);
+    return ui16_address_a;
+  }
+
+  if (profile_record_read (ui16_address_b, ui8_record)) { return ui16_address_b; }
+
+  return 0;
+}
+
+// applies the values stored on the profile slot to the configuration variables, that must have the profile 0 values
+static void profile_apply (uint8_t ui8_profile)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_bit = 0;
+  uint8_t ui8_data = PROFILE_OFFSET_DATA;
+  uint8_t ui8_record [EEPROM_PROFILE_SLOT_SIZE];
+  const struct_eeprom_field *p_field;
+
+  if ((ui8_profile == 0) || (ui8_profile >= EEPROM_PROFILES)) { return; }
+
+  // read on a local copy, ui8_profile_record can be queued for writing;
+  // never saved profile: same values as profile 0
+  if (profile_record_load (ui8_profile, ui8_record) == 0) { return; }
+
+  for (ui8_i = 0; ui8_i < EEPROM_SCHEMA_FIELDS; ui8_i++)
+  {
+    p_field = &eeprom_schema [ui8_i];
+    if (p_field->ui8_flags & EEPROM_FIELD_PROFILE)
+    {
+      if (ui8_record [PROFILE_OFFSET_BITMAP + (ui8_bit >> 3)] & (1 << (ui8_bit & 7)))
+      {
+        if ((ui8_data + p_field->ui8_variable_size) > PROFILE_OFFSET_CRC) { return; }
+
+        memcpy (((uint8_t *) get_configuration_variables ()) + p_field->ui8_variable_offset,
+            &ui8_record [ui8_data], p_field->ui8_variable_size);
+        ui8_data += p_field->ui8_variable_size;
+      }
+      ui8_bit++;
+    }
+  }
+}
+
+// queues the save of the values of the profile in use that are different from the profile 0 values
+static void profile_write (void)
+{
+  uint8_t ui8_i;
+  uint8_t ui8_bit = 0;
+  uint8_t ui8_data = PROFILE_OFFSET_DATA;
+  uint8_t ui8_profile = get_configuration_variables ()->ui8_profile;
+  uint8_t *p_variables = (uint8_t *) get_configuration_variables ();
+  uint8_t ui8_record [EEPROM_PROFILE_SLOT_SIZE];
+  uint16_t ui16_address;
+  const struct_eeprom_field *p_field;
+
+  if ((ui8_profile == 0) || (ui8_profile >= EEPROM_PROFILES)) { return; }
+
+  ui16_address = profile_record_load (ui8_profile, ui8_record);
+
+  memset (ui8_profile_record, 0, EEPROM_PROFILE_SLOT_SIZE);
+  ui8_profile_record [PROFILE_OFFSET_KEY] = PROFILE_KEY;
+  ui8_profile_record [PROFILE_OFFSET_SEQUENCE] = ui16_address ? ui8_record [PROFILE_OFFSET_SEQUENCE] + 1 : 0;
+
+  for (ui8_i = 0; ui8_i < EEPROM_SCHEMA_FIELDS; ui8_i++)
+  {
+    p_field = &eeprom_schema [ui8_i];
+    if (p_field->ui8_flags & EEPROM_FIELD_PROFILE)
+    {
+      if (eeprom_variable_get (p_variables, p_field) != eeprom_field_read (p_field))
+      {
+        ui8_profile_record [PROFILE_OFFSET_BITMAP + (ui8_bit >> 3)] |= 1 << (ui8_bit & 7);
+        memcpy (&ui8_profile_record [ui8_data], p_variables + p_field->ui8_variable_offset, p_field->ui8_variable_size);
+        ui8_data += p_field->ui8_variable_size;
+      }
+      ui8_bit++;
+    }
+  }
+
+  // same values as the record in use, nothing to write
+  if (ui16_address &&
+      (memcmp (&ui8_profile_record [PROFILE_OFFSET_BITMAP], &ui8_record [PROFILE_OFFSET_BITMAP],
+          PROFILE_OFFSET_CRC - PROFILE_OFFSET_BITMAP) == 0))
+  {
+    return;
+  }
+
+  profile_crc (ui8_profile_record);
+
+  // write on the slot not in use, the record in use is kept until the new one is fully written
+  eeprom_write_queue_add ((ui16_address == profile_slot_address (ui8_profile, 0)) ? profile_slot_address (ui8_profile, 1) :
+      profile_slot_address (ui8_profile, 0), ui8_profile_record, EEPROM_PROFILE_SLOT_SIZE, 0);
+}
+
+// switches to other profile and saves it as the profile in use
+void eeprom_profile_select (uint8_t ui8_profile)
+{
+  uint8_t ui8_i;
+  const struct_eeprom_field *p_field;
+
+  if (ui8_profile >= EEPROM_PROFILES) { return; }
+
+  // changes of the current profile must be saved before its values are replaced, a save requested while
+  // writing is queued by image_write_done () and also written by the flush
+  eeprom_write_flush ();
+
+  // profile 0 values from the image in use, then the differences of the new profile
+  for (ui8_i = 0; ui8_i < EEPROM_SCHEMA_FIELDS; ui8_i++)
+  {
+    p_field = &eeprom_schema [ui8_i];
+    if (p_field->ui8_flags & EEPROM_FIELD_PROFILE)
+    {
+      eeprom_variable_set ((uint8_t *) get_configuration_variables (), p_field, eeprom_field_read (p_field));
+    }
+  }
+  profile_apply (ui8_profile);
+
+  get_configuration_variables ()->ui8_profile = ui8_profile;
+  eeprom_write_variables ();
+}
+
+static uint8_t journal_read_record (uint8_t ui8_slot)
+{
+  uint8_t ui8_i;
+  uint16_t ui16_crc = 0xffff;
+  uint16_t ui16_address = EEPROM_JOURNAL_BASE_ADDRESS + (((uint16_t) ui8_slot) * EEPROM_JOURNAL_SLOT_SIZE);
+
+  for (ui8_i = 0; ui8_i < JOURNAL_RECORD_SIZE; ui8_i++)
+  {
+    ui8_journal_record [ui8_i] = FLASH_ReadByte (((uint32_t) ui16_address) + ((uint32_t) ui8_i));
+  }
+
+  if (ui8_journal_record [JOURNAL_OFFSET_KEY] != JOURNAL_KEY) { return 0; }
+
+  for (ui8_i = 0; ui8_i < JOURNAL_OFFSET_CRC; ui8_i++)
+  {
+    crc16 (ui8_journal_record [ui8_i], &ui16_crc);
+  }
+
+  return ((ui8_journal_record [JOURNAL_OFFSET_CRC] == (uint8_t) (ui16_crc & 255)) &&
+      (ui8_journal_record [JOURNAL_OFFSET_CRC + 1] == (uint8_t) (ui16_crc >> 8)));
+}
+
+static uint32_t journal_record_get_uint32 (uint8_t ui8_offset)
+{
+  return ((uint32_t) ui8_journal_record [ui8_offset]) |
+      (((uint32_t) ui8_journal_record [ui8_offset + 1]) << 8) |
+      (((uint32_t) ui8_journal_record [ui8_offset + 2]) << 16) |
+      (((uint32_t) ui8_journal_record [ui8_offset + 3]) << 24);
+}
+
+static void journal_record_set_uint32 (uint8_t *ui8_record, uint8_t ui8_offset, uint32_t ui32_value)
+{
+  ui8_record [ui8_offset] = ui32_value & 255;
+  ui8_record [ui8_offset + 1] = (ui32_value >> 8) & 255;
+  ui8_record [ui8_offset + 2] = (ui32_value >> 16) & 255;
+  ui8_record [ui8_offset + 3] = (ui32_value >> 24) & 255;
+}
+
+static void journal_load (void)
+{
+  uint8_t ui8_slot;
+  uint8_t ui8_newest_slot = 0;
+  uint8_t ui8_found = 0;
+  uint32_t ui32_sequence;
+
+  struct_configuration_variables *p_configuration_variables;
+  p_configuration_variables = get_configuration_variables ();
+
+  // find the valid record with the highest sequence number
+  for (ui8_slot = 0; ui8_slot < EEPROM_JOURNAL_SLOTS; ui8_slot++)
+  {
+    if (journal_read_record (ui8_slot))
+    {
+      ui32_sequence = journal_record_get_uint32 (JOURNAL_OFFSET_SEQUENCE);
+      if ((ui8_found == 0) || (ui32_sequence > ui32_journal_sequence))
+      {
+        ui8_found = 1;
+        ui8_newest_slot = ui8_slot;
+        ui32_journal_sequence = ui32_sequence;
+      }
+    }
+  }
+
+  // no valid record: keep the values stored with the other variables, next record goes to the first slot
+  if (ui8_found == 0)
+  {
+    ui8_journal_slot = EEPROM_JOURNAL_SLOTS - 1;
+    ui32_journal_sequence = 0;
+    journal_erase_next_block ();
+    return;
+  }
+
+  ui8_journal_slot = ui8_newest_slot;
+  journal_read_record (ui8_newest_slot);
+
+  p_configuration_variables->ui32_wh_x10_offset = journal_record_get_uint32 (JOURNAL_OFFSET_DATA + 0);
+  p_configuration_variables->ui32_odometer_x10 = journal_record_get_uint32 (JOURNAL_OFFSET_DATA + 4);
+  p_configuration_variables->ui32_trip_moving_time_seconds = journal_record_get_uint32 (JOURNAL_OFFSET_DATA + 8);
+  p_configuration_variables->ui32_trip_total_time_seconds = journal_record_get_uint32 (JOURNAL_OFFSET_DATA + 12);
+  p_configuration_variables->ui32_trip_energy_ws = journal_record_get_uint32 (JOURNAL_OFFSET_DATA + 16);
+  p_configuration_variables->ui16_odometer_distance_x10 = ((uint16_t) ui8_journal_record [JOURNAL_OFFSET_DATA + 20]) |
+      (((uint16_t) ui8_journal_record [JOURNAL_OFFSET_DATA + 21]) << 8);
+  p_configuration_variables->ui16_trip_max_speed_x10 = ((uint16_t) ui8_journal_record [JOURNAL_OFFSET_DATA + 22]) |
+      (((uint16_t) ui8_journal_record [JOURNAL_OFFSET_DATA + 23]) << 8);
+
+  journal_erase_next_block ();
 }
 
-static void variables_to_array (uint8_t *ui8_array)
+// prepares the record for the next slot
+static void journal_build (uint8_t *ui8_record, uint32_t ui32_wh_x10)
 {
-  uint8_t ui8_index;
+  uint8_t ui8_i;
+  uint16_t ui16_crc = 0xffff;
 
   struct_configuration_variables *p_configuration_variables;
   p_configuration_variables = get_configuration_variables ();
 
-  ui8_array [0] = KEY;
-  ui8_array [1] = p_configuration_variables->ui8_assist_level;
-  ui8_array [2] = p_configuration_variables->ui16_wheel_perimeter & 255;
-  ui8_array [3] = (p_configuration_variables->ui16_wheel_perimeter >> 8) & 255;
-  ui8_array [4] = p_configuration_variables->ui8_wheel_max_speed;
-  ui8_array [5] = p_configuration_variables->ui8_units_type;
-  ui8_array [6] = p_configuration_variables->ui32_wh_x10_offset & 255;
-  ui8_array [7] = (p_configuration_variables->ui32_wh_x10_offset >> 8) & 255;
-  ui8_array [8] = (p_configuration_variables->ui32_wh_x10_offset >> 16) & 255;
-  ui8_array [9] = (p_configuration_variables->ui32_wh_x10_offset >> 24) & 255;
-  ui8_array [10] = p_configuration_variables->ui32_wh_x10_100_percent & 255;
-  ui8_array [11] = (p_configuration_variables->ui32_wh_x10_100_percent >> 8) & 255;
-  ui8_array [12] = (p_configuration_variables->ui32_wh_x10_100_percent >> 16) & 255;
-  ui8_array [13] = (p_configuration_variables->ui32_wh_x10_100_percent >> 24) & 255;
-  ui8_array [14] = p_configuration_variables->ui8_show_numeric_battery_soc;
-  ui8_array [15] = p_configuration_variables->ui8_odometer_field_state;
-  ui8_array [16] = p_configuration_variables->ui8_battery_max_current;
-  ui8_array [17] = p_configuration_variables->ui8_target_max_battery_power;
-  ui8_array [18] = p_configuration_variables->ui8_battery_cells_number;
-  ui8_array [19] = p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 & 255;
-  ui8_array [20] = (p_configuration_variables->ui16_battery_low_voltage_cut_off_x10 >> 8) & 255;
-  ui8_array [21] = p_configuration_variables->ui8_pas_max_cadence;
-  ui8_array [22] = (p_configuration_variables->ui8_motor_voltage_type & 1) |
-                      ((p_configuration_variables->ui8_motor_assistance_startup_without_pedal_rotation & 1) << 1) |
-                      ((p_configuration_variables->ui8_throttle_adc_measures_motor_temperature & 1) << 2) |
-                      ((p_configuration_variables->ui8_temperature_field_config & 3) << 3);
-
-  for (ui8_index = 0; ui8_index < 9; ui8_index++)
-  {
-    ui8_array [23 + ui8_index] = p_configuration_variables->ui8_assist_level_power [ui8_index];
-  }
-  ui8_array [32] = p_configuration_variables->ui8_number_of_assist_levels;
-
-  ui8_array [33] = p_configuration_variables->ui8_startup_motor_power_boost_state;
-  for (ui8_index = 0; ui8_index < 9; ui8_index++)
-  {
-    ui8_array [34 + ui8_index] = p_configuration_variables->ui8_startup_motor_power_boost [ui8_index];
-  }
-  ui8_array [43] = p_configuration_variables->ui8_startup_motor_power_boost_time;
-  ui8_array [44] = p_configuration_variables->ui8_startup_motor_power_boost_fade_time;
-  ui8_array [45] = p_configuration_variables->ui8_motor_temperature_min_value_to_limit;
-  ui8_array [46] = p_configuration_variables->ui8_motor_temperature_max_value_to_limit;
-
-  ui8_array [47] = p_configuration_variables->ui16_battery_voltage_reset_wh_counter_x10 & 255;
-  ui8_array [48] = (p_configuration_variables->ui16_battery_voltage_reset_wh_counter_x10 >> 8) & 255;
-
-  ui8_array [49] = p_configuration_variables->ui8_lcd_power_off_time_minutes;
-  ui8_array [50] = p_configuration_variables->ui8_lcd_backlight_on_brightness;
-  ui8_array [51] = p_configuration_variables->ui8_lcd_backlight_off_brightness;
-
-  ui8_array [52] = p_configuration_variables->ui16_battery_pack_resistance_x1000 & 255;
-  ui8_array [53] = (p_configuration_variables->ui16_battery_pack_resistance_x1000 >> 8) & 255;
-
-  ui8_array [54] = p_configuration_variables->ui8_offroad_func_enabled;
-  ui8_array [55] = p_configuration_variables->ui8_offroad_enabled_on_startup;
-  ui8_array [56] = p_configuration_variables->ui8_offroad_speed_limit;
-  ui8_array [57] = p_configuration_variables->ui8_offroad_power_limit_enabled;
-  ui8_array [58] = p_configuration_variables->ui8_offroad_power_limit_div25;
-
-  ui8_array [59] = p_configuration_variables->ui32_odometer_x10 & 255;
-  ui8_array [60] = (p_configuration_variables->ui32_odometer_x10 >> 8) & 255;
-  ui8_array [61] = (p_configuration_variables->ui32_odometer_x10 >> 16) & 255;
-}
-
-static void eeprom_write_array (uint8_t *array, uint8_t ui8_len)
+  ui8_record [JOURNAL_OFFSET_KEY] = JOURNAL_KEY;
+  journal_record_set_uint32 (ui8_record, JOURNAL_OFFSET_SEQUENCE, ui32_journal_sequence + 1);
+  journal_record_set_uint32 (ui8_record, JOURNAL_OFFSET_DATA + 0, ui32_wh_x10);
+  journal_record_set_uint32 (ui8_record, JOURNAL_OFFSET_DATA + 4, p_configuration_variables->ui32_odometer_x10);
+  journal_record_set_uint32 (ui8_record, JOURNAL_OFFSET_DATA + 8, p_configuration_variables->ui32_trip_moving_time_seconds);
+  journal_record_set_uint32 (ui8_record, JOURNAL_OFFSET_DATA + 12, p_configuration_variables->ui32_trip_total_time_seconds);
+  journal_record_set_uint32 (ui8_record, JOURNAL_OFFSET_DATA + 16, p_configuration_variables->ui32_trip_energy_ws);
+  ui8_record [JOURNAL_OFFSET_DATA + 20] = p_configuration_variables->ui16_odometer_distance_x10 & 255;
+  ui8_record [JOURNAL_OFFSET_DATA + 21] = (p_configuration_variables->ui16_odometer_distance_x10 >> 8) & 255;
+  ui8_record [JOURNAL_OFFSET_DATA + 22] = p_configuration_variables->ui16_trip_max_speed_x10 & 255;
+  ui8_record [JOURNAL_OFFSET_DATA + 23] = (p_configuration_variables->ui16_trip_max_speed_x10 >> 8) & 255;
+
+  for (ui8_i = 0; ui8_i < JOURNAL_OFFSET_CRC; ui8_i++)
+  {
+    crc16 (ui8_record [ui8_i], &ui16_crc);
+  }
+  ui8_record [JOURNAL_OFFSET_CRC] = ui16_crc & 255;
+  ui8_record [JOURNAL_OFFSET_CRC + 1] = ui16_crc >> 8;
+}
+
+static uint16_t journal_slot_address (void)
+{
+  return EEPROM_JOURNAL_BASE_ADDRESS + (((uint16_t) ui8_journal_slot) * EEPROM_JOURNAL_SLOT_SIZE);
+}
+
+// first slot of the block after the block of the slot in use, the one kept erased for the power fail record
+static uint8_t journal_next_block_slot (void)
+{
+  return (((ui8_journal_slot / EEPROM_JOURNAL_SLOTS_PER_BLOCK) + 1) * EEPROM_JOURNAL_SLOTS_PER_BLOCK) % EEPROM_JOURNAL_SLOTS;
+}
+
+static uint8_t eeprom_block_erased (uint16_t ui16_address)
 {
   uint8_t ui8_i;
 
+  for (ui8_i = 0; ui8_i < FLASH_BLOCK_SIZE; ui8_i++)
+  {
+    if (FLASH_ReadByte (((uint32_t) ui16_address) + ((uint32_t) ui8_i))) { return 0; }
+  }
+
+  return 1;
+}
+
+static void journal_erase_done (void)
+{
+  ui8_journal_erase_queued = 0;
+}
+
+// the next block has only records older than the ones of the block in use, so it can be erased
+static void journal_erase_next_block (void)
+{
+  uint16_t ui16_address;
+
+  if (ui8_journal_erase_queued) { return; }
+
+  ui16_address = EEPROM_JOURNAL_BASE_ADDRESS + (((uint16_t) journal_next_block_slot ()) * EEPROM_JOURNAL_SLOT_SIZE);
+  if (eeprom_block_erased (ui16_address)) { return; }
+
+  ui8_journal_erase_queued = 1;
+  eeprom_write_queue_add (ui16_address, 0, FLASH_BLOCK_SIZE, journal_erase_done);
+}
+
+// power is failing: the record goes to the first slot of the next block with one block program operation, fast
+// programming if the block is erased. The other slots of the block are cleared. Like FLASH_ProgramBlock (), but
+// without a 128 bytes buffer on RAM.
+static void journal_write_block (uint8_t *ui8_record)
+{
+  uint8_t ui8_i;
+  uint8_t *p_block;
+
+  ui8_journal_slot = journal_next_block_slot ();
+  p_block = (uint8_t *) journal_slot_address ();
+
   if (FLASH_GetFlagStatus(FLASH_FLAG_DUL) == 0)
   {
     FLASH_Unlock (FLASH_MEMTYPE_DATA);
   }
 
-  for (ui8_i = 0; ui8_i < ui8_len; ui8_i++)
+  if (eeprom_block_erased (journal_slot_address ()))
   {
-    FLASH_ProgramByte (((uint32_t) EEPROM_BASE_ADDRESS) + ((uint32_t) ui8_i), *array++);
+    FLASH->CR2 |= FLASH_CR2_FPRG;
+    FLASH->NCR2 &= (uint8_t) (~FLASH_NCR2_NFPRG);
+  }
+  else
+  {
+    FLASH->CR2 |= FLASH_CR2_PRG;
+    FLASH->NCR2 &= (uint8_t) (~FLASH_NCR2_NPRG);
+  }
+
+  // the program operation starts after the last byte of the block is written
+  for (ui8_i = 0; ui8_i < FLASH_BLOCK_SIZE; ui8_i++)
+  {
+    p_block [ui8_i] = (ui8_i < JOURNAL_RECORD_SIZE) ? ui8_record [ui8_i] : 0;
   }
 
+  FLASH_WaitForLastOperation (FLASH_MEMTYPE_DATA);
   FLASH_Lock (FLASH_MEMTYPE_DATA);
 }
 
-void eeprom_erase_key_value (void)
+// the record prepared by journal_build () goes to the next slot
+static void journal_next_slot (void)
 {
-  uint8_t array_variables [1] = { 0 }; // key value is the first element, let's keep at 0
-  eeprom_write_array (array_variables, 1);
+  ui8_journal_slot = (ui8_journal_slot + 1) % EEPROM_JOURNAL_SLOTS;
+  ui32_journal_sequence++;
+  ui8_journal_staged = 0;
+}
+
+static void journal_write_done (void)
+{
+  ui8_journal_queued = 0;
+}
+
+static void journal_write (void)
+{
+  journal_build (ui8_journal_record, get_configuration_variables ()->ui32_wh_x10_offset);
+  journal_next_slot ();
+  ui8_journal_queued = 1;
+
+  // if power fails while writing, the CRC will be wrong and the previous record will be used
+  eeprom_write_queue_add (journal_slot_address (), ui8_journal_record, JOURNAL_RECORD_SIZE, journal_write_done);
+
+  // this record may be the first one on its block
+  journal_erase_next_block ();
+}
+
+void eeprom_journal_stage (uint32_t ui32_wh_x10)
+{
+  // the staged record is only valid for the next slot, not after other queued record
+  if (ui8_write_queue_count) { return; }
+
+  journal_build (ui8_journal_staged_record, ui32_wh_x10);
+  ui8_journal_staged = 1;
+}
+
+// power is failing: the staged record is written right away, other queued data is dropped
+void eeprom_journal_write_staged (void)
+{
+  eeprom_write_abort ();
+  ui8_journal_erase_queued = 0;
+
+  // a queued record has the newest values
+  if (ui8_journal_queued)
+  {
+    ui8_journal_queued = 0;
+    journal_write_block (ui8_journal_record);
+  }
+  else if (ui8_journal_staged)
+  {
+    journal_next_slot ();
+    journal_write_block (ui8_journal_staged_record);
+  }
+}
+
+static void journal_erase (void)
+{
+  uint8_t ui8_slot;
+  uint8_t ui8_key = 0;
+
+  // clear the key of all records, so the default values will be used
+  for (ui8_slot = 0; ui8_slot < EEPROM_JOURNAL_SLOTS; ui8_slot++)
+  {
+    eeprom_write_array (EEPROM_JOURNAL_BASE_ADDRESS + (((uint16_t) ui8_slot) * EEPROM_JOURNAL_SLOT_SIZE), &ui8_key, 1);
+  }
 }
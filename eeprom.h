@@ -9,78 +9,109 @@
 #ifndef _EEPROM_H_
 #define _EEPROM_H_
 
+#include <stddef.h>
 #include "lcd.h"
 
-#define KEY                                                                 0xe3
-
 #define EEPROM_BASE_ADDRESS                                                 0x4000
-#define ADDRESS_KEY                                                         0 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL                                                1 + EEPROM_BASE_ADDRESS
-#define ADDRESS_WHEEL_PERIMETER_0                                           2 + EEPROM_BASE_ADDRESS
-#define ADDRESS_WHEEL_PERIMETER_1                                           3 + EEPROM_BASE_ADDRESS
-#define ADDRESS_MAX_WHEEL_SPEED                                             4 + EEPROM_BASE_ADDRESS
-#define ADDRESS_UNITS_TYPE                                                  5 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_OFFSET_0                                             6 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_OFFSET_1                                             7 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_OFFSET_2                                             8 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_OFFSET_3                                             9 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_100_PERCENT_OFFSET_0                                 10 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_100_PERCENT_OFFSET_1                                 11 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_100_PERCENT_OFFSET_2                                 12 + EEPROM_BASE_ADDRESS
-#define ADDRESS_HW_X10_100_PERCENT_OFFSET_3                                 13 + EEPROM_BASE_ADDRESS
-#define ADDRESS_SHOW_NUMERIC_BATTERY_SOC                                    14 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ODOMETER_FIELD_STATE                                        15 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_MAX_CURRENT                                         16 + EEPROM_BASE_ADDRESS
-#define ADDRESS_TARGET_MAX_BATTERY_POWER                                    17 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_CELLS_NUMBER                                        18 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0                           19 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1                           20 + EEPROM_BASE_ADDRESS
-#define ADDRESS_PAS_MAX_CADENCE                                             21 + EEPROM_BASE_ADDRESS
-#define ADDRESS_CONFIG_0                                                    22 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_1                                       23 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_2                                       24 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_3                                       25 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_4                                       26 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_5                                       27 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_6                                       28 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_7                                       29 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_8                                       30 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ASSIST_LEVEL_FACTOR_9                                       31 + EEPROM_BASE_ADDRESS
-#define ADDRESS_NUMBER_OF_ASSIST_LEVELS                                     32 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_STATE                             33 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_1                    34 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_2                    35 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_3                    36 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_4                    37 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_5                    38 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_6                    39 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_7                    40 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_8                    41 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_ASSIST_LEVEL_9                    42 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_TIME                              43 + EEPROM_BASE_ADDRESS
-#define ADDRESS_STARTUP_MOTOR_POWER_BOOST_FADE_TIME                         44 + EEPROM_BASE_ADDRESS
-#define ADDRESS_MOTOR_TEMPERATURE_MIN_VALUE_LIMIT                           45 + EEPROM_BASE_ADDRESS
-#define ADDRESS_MOTOR_TEMPERATURE_MAX_VALUE_LIMIT                           46 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_0                      47 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_1                      48 + EEPROM_BASE_ADDRESS
-#define ADDRESS_LCD_POWER_OFF_TIME                                          49 + EEPROM_BASE_ADDRESS
-#define ADDRESS_LCD_BACKLIGHT_ON_BRIGHTNESS                                 50 + EEPROM_BASE_ADDRESS
-#define ADDRESS_LCD_BACKLIGHT_OFF_BRIGHTNESS                                51 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_PACK_RESISTANCE_0                                   52 + EEPROM_BASE_ADDRESS
-#define ADDRESS_BATTERY_PACK_RESISTANCE_1                                   53 + EEPROM_BASE_ADDRESS
-#define ADDRESS_DEFAULT_VALUE_OFFROAD_FUNC_ENABLED                          54 + EEPROM_BASE_ADDRESS
-#define ADDRESS_DEFAULT_VALUE_OFFROAD_MODE_ENABLED_ON_STARTUP               55 + EEPROM_BASE_ADDRESS
-#define ADDRESS_DEFAULT_VALUE_OFFROAD_SPEED_LIMIT                           56 + EEPROM_BASE_ADDRESS
-#define ADDRESS_DEFAULT_VALUE_OFFROAD_POWER_LIMIT_ENABLED                   57 + EEPROM_BASE_ADDRESS
-#define ADDRESS_DEFAULT_VALUE_OFFROAD_POWER_LIMIT_DIV25                     58 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ODOMETER_X10_0                                              59 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ODOMETER_X10_1                                              60 + EEPROM_BASE_ADDRESS
-#define ADDRESS_ODOMETER_X10_2                                              61 + EEPROM_BASE_ADDRESS
-#define EEPROM_BYTES_STORED                                                 62
+
+// The configuration variables are stored on two images, A and B, each one on its own EEPROM block. Each save goes
+// to the image not in use, so if power fails while writing, the other image is still valid.
+// Image: header (magic, version, length of the data, sequence number, CRC16 of header and data) + data
+// Data of version 2 images is the memory image of struct_configuration_variables up to the not stored variables,
+// so it is copied as it is at startup
+#define EEPROM_IMAGE_A_ADDRESS                                              0x4000
+#define EEPROM_IMAGE_B_ADDRESS                                              0x4080
+#define EEPROM_IMAGE_MAGIC                                                  0x4c
+#define EEPROM_IMAGE_VERSION                                                2
+#define EEPROM_IMAGE_OFFSET_MAGIC                                           0
+#define EEPROM_IMAGE_OFFSET_VERSION                                         1
+#define EEPROM_IMAGE_OFFSET_LENGTH                                          2
+#define EEPROM_IMAGE_OFFSET_SEQUENCE                                        3
+#define EEPROM_IMAGE_OFFSET_CRC                                             4
+#define EEPROM_IMAGE_OFFSET_DATA                                            6
+#define EEPROM_BYTES_STORED                                                 (offsetof (struct_configuration_variables, ui8_cruise_control))
+#define EEPROM_IMAGE_MAX_BYTES_STORED                                       (FLASH_BLOCK_SIZE - EEPROM_IMAGE_OFFSET_DATA)
+#define EEPROM_IMAGE_SIZE                                                   (EEPROM_IMAGE_OFFSET_DATA + EEPROM_BYTES_STORED)
+
+// Previous firmware versions stored only the data at EEPROM_BASE_ADDRESS, with a key on the first byte,
+// they are read as version 0 images, using the schema addresses, see eeprom.c
+#define EEPROM_LEGACY_KEY                                                   0xe3
+#define EEPROM_LEGACY_BYTES_STORED                                          62
+
+// Each configuration variable stored on EEPROM is described by one entry of the schema table, see eeprom.c
+typedef struct _eeprom_field
+{
+  uint8_t ui8_address;                // offset on the data of version 0 images
+  uint8_t ui8_variable_offset;        // offset of the variable on struct_configuration_variables
+  uint8_t ui8_variable_size;          // 1, 2 or 4 bytes
+  uint8_t ui8_eeprom_size;            // bytes on version 0 images, little endian
+  uint8_t ui8_bit_shift;              // for variables packed as bits of a byte
+  uint8_t ui8_bit_mask;               // 0 if the variable uses all the bytes
+  uint8_t ui8_flags;
+  uint16_t ui16_default;
+  uint16_t ui16_min;
+  uint32_t ui32_max;
+} struct_eeprom_field;
+
+// the variable is saved on the journal and the value at the schema address is only the initial one
+#define EEPROM_FIELD_JOURNAL                                                1
+// the variable can have a different value on each profile
+#define EEPROM_FIELD_PROFILE                                                2
+
+// Journal: wear leveling for the values that change on every ride (Wh, odometer and trip), see eeprom.c
+#define EEPROM_JOURNAL_BASE_ADDRESS                                         0x4100
+#define EEPROM_JOURNAL_SLOTS                                                16
+#define EEPROM_JOURNAL_SLOT_SIZE                                            32
+#define EEPROM_JOURNAL_SLOTS_PER_BLOCK                                      (FLASH_BLOCK_SIZE / EEPROM_JOURNAL_SLOT_SIZE)
+#define JOURNAL_KEY                                                         0xa5
+#define JOURNAL_OFFSET_KEY                                                  0
+#define JOURNAL_OFFSET_SEQUENCE                                             1
+#define JOURNAL_OFFSET_DATA                                                 5
+#define JOURNAL_DATA_SIZE                                                   24
+#define JOURNAL_OFFSET_CRC                                                  (JOURNAL_OFFSET_DATA + JOURNAL_DATA_SIZE)
+#define JOURNAL_RECORD_SIZE                                                 (JOURNAL_OFFSET_CRC + 2)
+
+// Profiles: profile 0 is the configuration image, profiles 1 to 3 are stored only as the values of the
+// EEPROM_FIELD_PROFILE variables that are different from profile 0, see eeprom.c. Like the images, each profile has
+// two slots, A and B, and each save goes to the slot not in use: 6 slots from EEPROM_PROFILES_BASE_ADDRESS up to
+// the end of the EEPROM.
+// Record: key + sequence number + bitmap of the variables stored (schema order) + their values + CRC16
+#define EEPROM_PROFILES                                                     4
+#define EEPROM_PROFILES_BASE_ADDRESS                                        0x4300
+#define EEPROM_PROFILE_SLOT_SIZE                                            42
+#define PROFILE_KEY                                                         0x5b
+#define PROFILE_OFFSET_KEY                                                  0
+#define PROFILE_OFFSET_SEQUENCE                                             1
+#define PROFILE_OFFSET_BITMAP                                               2
+#define PROFILE_BITMAP_SIZE                                                 4
+#define PROFILE_OFFSET_DATA                                                 (PROFILE_OFFSET_BITMAP + PROFILE_BITMAP_SIZE)
+#define PROFILE_OFFSET_CRC                                                  (EEPROM_PROFILE_SLOT_SIZE - 2)
+// number of EEPROM_FIELD_PROFILE variables on the schema and the size of all their values, for the compile time check
+// of the record size on eeprom.c: keep them updated with the schema, tools/eeprom_tool.py checks them
+#define PROFILE_FIELDS                                                      32
+#define PROFILE_DATA_SIZE                                                   33
+
+// Background writer queue
+#define EEPROM_WRITE_QUEUE_SIZE                                             4
+
+typedef struct _eeprom_write_job
+{
+  uint16_t ui16_address;
+  uint8_t *p_data;                    // must not change until the job is done, 0 to erase the block at ui16_address
+  uint8_t ui8_len;
+  void (*p_done) (void);              // called when all the data is written, can be 0
+} struct_eeprom_write_job;
 
 void eeprom_init (void);
 void eeprom_init_variables (void);
 void eeprom_write_variables (void);
 void eeprom_erase_key_value (void);
+uint16_t eeprom_get_write_time (void);
+void eeprom_write_flush (void);
+void clock_eeprom (void);
+void eeprom_journal_stage (uint32_t ui32_wh_x10);
+void eeprom_journal_write_staged (void);
+void eeprom_write_retry (void);
+void eeprom_profile_select (uint8_t ui8_profile);
 
 #endif /* _EEPROM_H_ */
@@ -0,0 +1,67 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "filter.h"
+
+void filter_init (struct_filter *p_filter, uint8_t ui8_coefficient, uint32_t ui32_fast_response_threshold)
+{
+  if (ui8_coefficient > FILTER_COEFFICIENT_MAX) { ui8_coefficient = FILTER_COEFFICIENT_MAX; }
+
+  p_filter->ui32_accumulated = 0;
+  p_filter->ui32_fast_response_threshold = ui32_fast_response_threshold;
+  p_filter->ui8_coefficient = ui8_coefficient;
+  p_filter->ui8_first_update = 1;
+}
+
+void filter_set_coefficient (struct_filter *p_filter, uint8_t ui8_coefficient)
+{
+  if (ui8_coefficient > FILTER_COEFFICIENT_MAX) { ui8_coefficient = FILTER_COEFFICIENT_MAX; }
+
+  // rescale the accumulated value so the output will keep the same value
+  if (ui8_coefficient != p_filter->ui8_coefficient)
+  {
+    p_filter->ui32_accumulated = (p_filter->ui32_accumulated >> p_filter->ui8_coefficient) << ui8_coefficient;
+    p_filter->ui8_coefficient = ui8_coefficient;
+  }
+}
+
+void filter_set_fast_response_threshold (struct_filter *p_filter, uint32_t ui32_fast_response_threshold)
+{
+  p_filter->ui32_fast_response_threshold = ui32_fast_response_threshold;
+}
+
+uint32_t filter_update (struct_filter *p_filter, uint32_t ui32_input)
+{
+  uint32_t ui32_output;
+  uint32_t ui32_delta;
+
+  ui32_output = p_filter->ui32_accumulated >> p_filter->ui8_coefficient;
+  ui32_delta = (ui32_input > ui32_output) ? (ui32_input - ui32_output) : (ui32_output - ui32_input);
+
+  // start from the first value and on fast response mode, follow immediately a step change bigger than the threshold
+  if (p_filter->ui8_first_update ||
+      (p_filter->ui32_fast_response_threshold && (ui32_delta > p_filter->ui32_fast_response_threshold)))
+  {
+    p_filter->ui8_first_update = 0;
+    p_filter->ui32_accumulated = ui32_input << p_filter->ui8_coefficient;
+  }
+  else
+  {
+    p_filter->ui32_accumulated -= p_filter->ui32_accumulated >> p_filter->ui8_coefficient;
+    p_filter->ui32_accumulated += ui32_input;
+  }
+
+  return p_filter->ui32_accumulated >> p_filter->ui8_coefficient;
+}
+
+uint32_t filter_get_output (struct_filter *p_filter)
+{
+  return p_filter->ui32_accumulated >> p_filter->ui8_coefficient;
+}
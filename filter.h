@@ -0,0 +1,34 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include "main.h"
+
+// Possible coefficient values: 0 up to FILTER_COEFFICIENT_MAX
+// 0 equal to no filtering and no delay, higher values will increase filtering but will also add bigger delay
+#define FILTER_COEFFICIENT_MAX 8
+
+// first order IIR / exponential moving average: output = accumulated >> coefficient
+// input values must be lower than (2^32 >> FILTER_COEFFICIENT_MAX) so the accumulated value will not overflow
+typedef struct _filter
+{
+  uint32_t ui32_accumulated;
+  uint32_t ui32_fast_response_threshold; // 0 = fast response disabled
+  uint8_t ui8_coefficient;
+  uint8_t ui8_first_update;
+} struct_filter;
+
+void filter_init (struct_filter *p_filter, uint8_t ui8_coefficient, uint32_t ui32_fast_response_threshold);
+void filter_set_coefficient (struct_filter *p_filter, uint8_t ui8_coefficient);
+void filter_set_fast_response_threshold (struct_filter *p_filter, uint32_t ui32_fast_response_threshold);
+uint32_t filter_update (struct_filter *p_filter, uint32_t ui32_input);
+uint32_t filter_get_output (struct_filter *p_filter);
+
+#endif /* _FILTER_H_ */
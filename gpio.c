@@ -8,6 +8,7 @@
 
 #include "stm8s.h"
 #include "stm8s_gpio.h"
+#include "stm8s_exti.h"
 #include "pins.h"
 
 void gpio_init (void)
@@ -16,13 +17,18 @@ void gpio_init (void)
             LCD3_BUTTON_ONOFF__PIN,
             GPIO_MODE_IN_FL_NO_IT);
 
+  // UP and DOWN buttons edges are captured by the port B interrupt, see button.c;
+  // ONOFF button is on port G, that has no external interrupt, so it is only polled
   GPIO_Init(LCD3_BUTTON_UP__PORT,
             LCD3_BUTTON_UP__PIN,
-            GPIO_MODE_IN_PU_NO_IT);
+            GPIO_MODE_IN_PU_IT);
 
   GPIO_Init(LCD3_BUTTON_DOWN__PORT,
             LCD3_BUTTON_DOWN__PIN,
-            GPIO_MODE_IN_PU_NO_IT);
+            GPIO_MODE_IN_PU_IT);
+
+  // can only be configured while interrupts are disabled
+  EXTI_SetExtIntSensitivity(EXTI_PORT_GPIOB, EXTI_SENSITIVITY_RISE_FALL);
 
   GPIO_Init(LCD3_ENABLE_BACKLIGHT__PORT,
             LCD3_ENABLE_BACKLIGHT__PIN,
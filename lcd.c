@@ -21,8 +21,13 @@
 #include "eeprom.h"
 #include "pins.h"
 #include "uart.h"
+#include "battery.h"
+#include "filter.h"
+#include "trip.h"
+#include "range.h"
+#include "odometer.h"
 
-#define LCD_MENU_CONFIG_SUBMENU_MAX_NUMBER 10
+#define LCD_MENU_CONFIG_SUBMENU_MAX_NUMBER 10 // submenus of menu_items
 
 uint8_t ui8_lcd_frame_buffer[LCD_FRAME_BUFFER_SIZE];
 
@@ -61,29 +66,28 @@ uint8_t ui8_lcd_digit_mask_inverted[] = {
     NUMBER_9_MASK_INVERTED
 };
 
-static uint32_t ui32_battery_voltage_accumulated_x10000 = 0;
+static struct_filter battery_voltage_filter;
 static uint16_t ui16_battery_voltage_filtered_x10;
 
-static uint16_t ui16_battery_current_accumulated_x5 = 0;
+static struct_filter battery_current_filter;
 static uint16_t ui16_battery_current_filtered_x5;
 
 static uint16_t ui16_battery_power_accumulated = 0;
 static uint16_t ui16_battery_power_filtered_x50;
 static uint16_t ui16_battery_power_filtered;
 
-static uint32_t ui32_wh_sum_x5 = 0;
-static uint32_t ui32_wh_sum_counter = 0;
 static uint32_t ui32_wh_x10 = 0;
 static uint8_t ui8_config_wh_x10_offset;
 
 static uint32_t ui32_torque_sensor_force_x1000;
-static uint32_t ui32_torque_accumulated = 0;
+static struct_filter pedal_torque_filter;
 static uint16_t ui32_torque_accumulated_filtered_x10;
 
 static uint8_t ui8_motor_controller_init = 1;
 
 static uint8_t ui8_lights_state = 0;
 static uint8_t lcd_lights_symbol = 0;
+static uint8_t ui8_walk_assist_state = 0;
 
 static uint8_t ui8_lcd_menu = 0;
 static uint8_t ui8_lcd_menu_config_submenu_state = 0;
@@ -97,10 +101,25 @@ static uint8_t ui8_lcd_menu_config_submenu_active = 0;
 static struct_motor_controller_data motor_controller_data;
 static struct_configuration_variables configuration_variables;
 
-static uint16_t ui16_battery_soc_watts_hour;
+static uint16_t ui16_battery_soc;
+
+// values derived from the configuration variables, they only change when the user changes the configurations
+// and so they are calculated only once after each configuration change, not on every use
+typedef struct _derived_values
+{
+  uint16_t ui16_adc_battery_voltage_reset_wh_counter; // motor controller ADC units
+  uint8_t ui8_speed_factor_x8; // km/h * ui8_speed_factor_x8 / 8 = km/h or mph
+} struct_derived_values;
+
+static struct_derived_values derived_values;
+static uint8_t ui8_derived_values_valid = 0;
+
+// battery symbol bars: 80%, 60%, 40%, 20% and 10% state of charge
+#define BATTERY_SOC_THRESHOLDS_NUMBER 5
+static const uint16_t ui16_battery_soc_threshold_x10 [BATTERY_SOC_THRESHOLDS_NUMBER] = { 800, 600, 400, 200, 100 };
 
 static uint8_t ui8_reset_to_defaults_counter;
-static uint8_t ui8_state_temp_field;
+static uint8_t ui8_profile_show_counter = 0;
 
 uint8_t ui8_lcd_power_off_time_counter_minutes = 0;
 static uint16_t ui16_lcd_power_off_time_counter = 0;
@@ -108,6 +127,148 @@ static uint16_t ui16_lcd_power_off_time_counter = 0;
 static uint8_t offroad_mode_assist_symbol_state = 0;
 static uint8_t offroad_mode_assist_symbol_state_blink_counter = 0;
 
+// Configuration menus
+//
+// Each submenu is a list of items of menu_items, up to a MENU_END, all shown and edited by menu_execute_item ().
+// An item is a variable, or one bit of it, or with MENU_ITEM_ASSIST_LEVELS one item for each assist level of an array.
+// ONOFF click goes to the next item of the submenu and UP and DOWN change the value.
+typedef struct _menu_item
+{
+  void *p_value;
+  uint8_t ui8_size;                   // 1, 2 or 4 bytes, 0 on MENU_END
+  uint8_t ui8_bit_mask;               // on/off item for the bit of the variable, 0 to use all the variable
+  uint16_t ui16_step;
+  uint16_t ui16_min;
+  uint32_t ui32_max;
+  uint8_t ui8_field;
+  uint8_t ui8_scale;                  // the value is shown multiplied by scale
+  uint8_t ui8_options;                // lcd_print () options
+  uint8_t ui8_flags;
+  void (*p_function) (void);          // called after the value is edited and before it is shown, can be 0
+} struct_menu_item;
+
+#define MENU_ITEM_KMH                 1   // km/h symbol
+#define MENU_ITEM_UNITS               2   // the value is shown as the km/h (0) or mph (1) symbol, not as a number
+#define MENU_ITEM_READ_ONLY           4   // always shown, not flashing, and can't be changed
+#define MENU_ITEM_NO_REPEAT           8   // only clicks change the value, holding the button does nothing
+#define MENU_ITEM_ASSIST_LEVELS       16  // one item for each assist level, the variable is the first of the array
+
+#define MENU_VALUE(variable, min, max, step, field, scale, options, flags) \
+  { &configuration_variables.variable, sizeof (configuration_variables.variable), 0, step, min, max, \
+    field, scale, options, flags, 0 }
+#define MENU_BIT(variable, mask) \
+  { &configuration_variables.variable, 1, mask, 1, 0, 1, ODOMETER_FIELD, 1, 1, 0, 0 }
+#define MENU_SHOW(variable) \
+  { &motor_controller_data.variable, sizeof (motor_controller_data.variable), 0, 1, 0, 0, \
+    ODOMETER_FIELD, 1, 1, MENU_ITEM_READ_ONLY, 0 }
+#define MENU_END \
+  { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+
+static void menu_wh_x10_offset (void);
+static void menu_reset_to_defaults (void);
+static void menu_reset_trip (void);
+static void menu_eeprom_write_time (void);
+static void menu_button_events_lost (void);
+
+static uint16_t ui16_menu_eeprom_write_time_ms;
+static uint8_t ui8_menu_button_events_lost;
+
+// the submenus, in order, LCD_MENU_CONFIG_SUBMENU_MAX_NUMBER of them
+static const struct_menu_item menu_items [] = {
+    // wheel
+    MENU_VALUE (ui8_wheel_max_speed, 1, 99, 1, WHEEL_SPEED_FIELD, 10, 0, MENU_ITEM_KMH),
+    MENU_VALUE (ui16_wheel_perimeter, 750, 3000, 10, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui8_units_type, 0, 1, 1, ODOMETER_FIELD, 1, 1, MENU_ITEM_UNITS),
+    MENU_END,
+
+    // battery
+    MENU_VALUE (ui8_battery_max_current, 0, 100, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui16_battery_low_voltage_cut_off_x10, BATTERY_VOLTAGE_X10_MIN, BATTERY_VOLTAGE_X10_MAX, 1, ODOMETER_FIELD, 1, 0, 0),
+    MENU_VALUE (ui8_battery_cells_number, 7, 15, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui16_battery_pack_resistance_x1000, 0, 1001, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_END,
+
+    // battery SOC: show numeric value, show it as decrementing percentage, voltage to reset the Wh counter,
+    // Wh of 100% SOC and current Wh
+    MENU_BIT (ui8_show_numeric_battery_soc, 1),
+    MENU_BIT (ui8_show_numeric_battery_soc, 2),
+    MENU_VALUE (ui16_battery_voltage_reset_wh_counter_x10, BATTERY_VOLTAGE_X10_MIN, BATTERY_VOLTAGE_X10_MAX, 1, ODOMETER_FIELD, 1, 0, 0),
+    MENU_VALUE (ui32_wh_x10_100_percent, 0, 99900, 100, ODOMETER_FIELD, 1, 0, 0),
+    { &configuration_variables.ui32_wh_x10_offset, 4, 0, 100, 0, 99900, ODOMETER_FIELD, 1, 0, 0, menu_wh_x10_offset },
+    MENU_END,
+
+    // assist levels: number of them and power of each one
+    MENU_VALUE (ui8_number_of_assist_levels, 1, 9, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui8_assist_level_power [0], 0, 255, 1, ODOMETER_FIELD, 25, 1, MENU_ITEM_ASSIST_LEVELS),
+    MENU_END,
+
+    // motor startup power boost: enable, limit to max power, time, fade time and power of each assist level
+    MENU_BIT (ui8_startup_motor_power_boost_state, 1),
+    MENU_BIT (ui8_startup_motor_power_boost_state, 2),
+    MENU_VALUE (ui8_startup_motor_power_boost_time, 0, 255, 1, ODOMETER_FIELD, 1, 0, 0),
+    MENU_VALUE (ui8_startup_motor_power_boost_fade_time, 0, 255, 1, ODOMETER_FIELD, 1, 0, 0),
+    MENU_VALUE (ui8_startup_motor_power_boost [0], 0, 255, 1, ODOMETER_FIELD, 25, 1, MENU_ITEM_ASSIST_LEVELS),
+    MENU_END,
+
+    // motor temperature: enable and limits
+    MENU_VALUE (ui8_throttle_adc_measures_motor_temperature, 0, 1, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui8_motor_temperature_min_value_to_limit, 0, 110, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui8_motor_temperature_max_value_to_limit, 0, 110, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_END,
+
+    // LCD: backlight off and on brightness (shown in steps of 5%), auto power off minutes (0 disables) and
+    // reset to defaults after 10 clicks
+    MENU_VALUE (ui8_lcd_backlight_off_brightness, 0, 20, 1, ODOMETER_FIELD, 5, 1, 0),
+    MENU_VALUE (ui8_lcd_backlight_on_brightness, 0, 20, 1, ODOMETER_FIELD, 5, 1, 0),
+    MENU_VALUE (ui8_lcd_power_off_time_minutes, 0, LCD_POWER_OFF_TIME_MAX, 1, ODOMETER_FIELD, 1, 1, 0),
+    { &ui8_reset_to_defaults_counter, 1, 0, 1, 0, 10, ODOMETER_FIELD, 1, 1, MENU_ITEM_NO_REPEAT, menu_reset_to_defaults },
+    MENU_END,
+
+    // offroad mode: enable, enable on startup, speed limit, enable power limit and power limit
+    MENU_BIT (ui8_offroad_func_enabled, 1),
+    MENU_BIT (ui8_offroad_enabled_on_startup, 1),
+    MENU_VALUE (ui8_offroad_speed_limit, 1, 99, 1, WHEEL_SPEED_FIELD, 10, 0, MENU_ITEM_KMH),
+    MENU_BIT (ui8_offroad_power_limit_enabled, 1),
+    MENU_VALUE (ui8_offroad_power_limit_div25, 4, 40, 1, ODOMETER_FIELD, 25, 1, 0),
+    MENU_END,
+
+    // various: motor voltage type, assistance startup without pedal rotation, PAS max cadence, reset trip distance
+    // after 10 clicks, filters coefficients and filters fast response (bit 0 battery voltage; bit 1 battery current;
+    // bit 2 pedal torque)
+    MENU_BIT (ui8_motor_voltage_type, 1),
+    MENU_BIT (ui8_motor_assistance_startup_without_pedal_rotation, 1),
+    MENU_VALUE (ui8_pas_max_cadence, PAS_MAX_CADENCE_MIN, PAS_MAX_CADENCE_MAX, 1, ODOMETER_FIELD, 1, 1, 0),
+    { &ui8_reset_to_defaults_counter, 1, 0, 1, 0, 10, ODOMETER_FIELD, 1, 1, MENU_ITEM_NO_REPEAT, menu_reset_trip },
+    MENU_VALUE (ui8_battery_voltage_filter_coefficient, 0, FILTER_COEFFICIENT_MAX, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui8_battery_current_filter_coefficient, 0, FILTER_COEFFICIENT_MAX, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui8_pedal_torque_filter_coefficient, 0, FILTER_COEFFICIENT_MAX, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_VALUE (ui8_filter_fast_response, 0, 7, 1, ODOMETER_FIELD, 1, 1, 0),
+    MENU_END,
+
+    // technical: values from the motor controller, time of the last EEPROM save and button events lost
+    MENU_SHOW (ui8_adc_throttle),
+    MENU_SHOW (ui8_throttle),
+    MENU_SHOW (ui8_adc_pedal_torque_sensor),
+    MENU_SHOW (ui8_pedal_torque_sensor),
+    MENU_SHOW (ui8_pedal_cadence),
+    MENU_SHOW (ui8_pedal_human_power),
+    MENU_SHOW (ui8_duty_cycle),
+    MENU_SHOW (ui16_motor_speed_erps),
+    MENU_SHOW (ui8_foc_angle),
+    { &ui16_menu_eeprom_write_time_ms, 2, 0, 1, 0, 0, ODOMETER_FIELD, 1, 1, MENU_ITEM_READ_ONLY, menu_eeprom_write_time },
+    { &ui8_menu_button_events_lost, 1, 0, 1, 0, 0, ODOMETER_FIELD, 1, 1, MENU_ITEM_READ_ONLY, menu_button_events_lost },
+    MENU_END
+  };
+
+// the BATTERY_POWER_FIELD can't show higher value
+static const struct_menu_item menu_item_target_max_battery_power =
+  MENU_VALUE (ui8_target_max_battery_power, 0, 190, 1, BATTERY_POWER_FIELD, 25, 0, 0);
+
+static uint8_t ui8_menu_edit_repeats;
+static void *p_menu_edit_digits_value = 0;   // value on digit by digit entry, 0 if none
+static uint32_t ui32_menu_edit_digits_value;
+static uint32_t ui32_menu_edit_digit_weight;
+
 void low_pass_filter_battery_voltage_current_power (void);
 void lcd_enable_motor_symbol (uint8_t ui8_state);
 void lcd_enable_lights_symbol (uint8_t ui8_state);
@@ -117,6 +278,8 @@ void lcd_enable_wheel_speed_point_symbol (uint8_t ui8_state);
 void lcd_enable_kmh_symbol (uint8_t ui8_state);
 void lcd_enable_mph_symbol (uint8_t ui8_state);
 void lcd_enable_odo_symbol (uint8_t ui8_state);
+void lcd_enable_mil_symbol (uint8_t ui8_state);
+void lcd_enable_distance_unit_symbol (uint8_t ui8_state);
 void calc_wh (void);
 void assist_level_state (void);
 void brake (void);
@@ -130,28 +293,19 @@ void temperature (void);
 void battery_soc (void);
 void low_pass_filter_pedal_torque (void);
 void lights_state (void);
-void lcd_set_backlight_intensity (uint8_t ui8_intensity);
 void walk_assist_state (void);
 void offroad_mode (void);
 void lcd_execute_main_screen (void);
 void lcd_execute_menu_config (void);
 void lcd_execute_menu_config_power (void);
-void lcd_execute_menu_config_submenu_wheel_config (void);
-void lcd_execute_menu_config_submenu_battery (void);
-void lcd_execute_menu_config_submenu_battery_soc (void);
-void lcd_execute_menu_config_submenu_assist_level (void);
-void lcd_execute_menu_config_submenu_motor_startup_power_boost (void);
-void lcd_execute_menu_config_submenu_motor_temperature (void);
-void lcd_execute_menu_config_submenu_lcd ();
-void lcd_execute_menu_config_submenu_offroad_mode (void);
-void lcd_execute_menu_config_submenu_various (void);
-void lcd_execute_menu_config_submenu_technical (void);
+void lcd_execute_menu_config_submenu (void);
 void update_menu_flashing_state (void);
 void advance_on_submenu (uint8_t* ui8_p_state, uint8_t ui8_state_max_number);
-void calc_battery_soc_watts_hour (void);
-void calc_odometer (void);
+static void menu_execute_item (const struct_menu_item *p_item, uint8_t ui8_index);
+void calc_battery_soc (void);
 static void automatic_power_off_management (void);
 void lcd_power_off (void);
+static void calc_derived_values (void);
 void lcd_enable_vol_symbol (uint8_t ui8_state);
 void lcd_enable_w_symbol (uint8_t ui8_state);
 void lcd_enable_odometer_point_symbol (uint8_t ui8_state);
@@ -164,6 +318,10 @@ void lcd_enable_wheel_speed_point_symbol (uint8_t ui8_state);
 void lcd_enable_temperature_degrees_symbol (uint8_t ui8_state);
 void lcd_enable_dst_symbol (uint8_t ui8_state);
 void lcd_enable_tm_symbol (uint8_t ui8_state);
+void lcd_enable_ttm_symbol (uint8_t ui8_state);
+void lcd_enable_avs_symbol (uint8_t ui8_state);
+void lcd_enable_mxs_symbol (uint8_t ui8_state);
+void lcd_enable_timer_colon_symbol (uint8_t ui8_state);
 void lcd_update (void);
 void lcd_clear (void);
 void lcd_set_frame_buffer (void);
@@ -172,55 +330,66 @@ void lcd_print (uint32_t ui32_number, uint8_t ui8_lcd_field, uint8_t ui8_options
 void clock_lcd (void)
 {
   lcd_clear (); // start by clear LCD
+
+  if (!ui8_derived_values_valid) { calc_derived_values (); }
+
   if (first_time_management ())
     return;
 
   update_menu_flashing_state ();
 
-  // enter menu configurations: UP + DOWN click event
-  if (get_button_up_down_click_event () &&
+  // enter menu configurations: UP + DOWN long click event
+  if (get_button_up_down_long_click_event () &&
       ui8_lcd_menu != 1)
   {
-    clear_button_up_down_click_event ();
+    clear_button_up_down_long_click_event ();
     ui8_lcd_menu = 1;
   }
 
-  // enter in menu set power: ONOFF + UP click event
-  if (!configuration_variables.ui8_offroad_func_enabled && 
-      get_button_onoff_state () && get_button_up_state ())
+  // enter in menu set power: ONOFF + UP click event, with offroad function ONOFF + UP is used by offroad_mode ()
+  if (!configuration_variables.ui8_offroad_func_enabled &&
+      get_button_onoff_up_click_event ())
   {
-    button_clear_events ();
+    clear_button_onoff_up_click_event ();
     ui8_lcd_menu = 2;
   }
 
-  // change temperature field state: ONOFF + DOWN click event
-  if (!configuration_variables.ui8_offroad_func_enabled && 
-      get_button_onoff_state () && get_button_down_state ())
+  // change temperature field state: ONOFF + DOWN click event, with offroad function it is used by offroad_mode ()
+  if (!configuration_variables.ui8_offroad_func_enabled &&
+      get_button_onoff_down_click_event ())
   {
-    button_clear_events ();
+    clear_button_onoff_down_click_event ();
 
-    if (ui8_state_temp_field == 0)
-    {
-      configuration_variables.ui8_temperature_field_config++;
-
-      if (configuration_variables.ui8_throttle_adc_measures_motor_temperature)
-      {
-        if (configuration_variables.ui8_temperature_field_config > 2) { configuration_variables.ui8_temperature_field_config = 0; }
-      }
-      else
-      {
-        if (configuration_variables.ui8_temperature_field_config > 1) { configuration_variables.ui8_temperature_field_config = 0; }
-      }
+    configuration_variables.ui8_temperature_field_config++;
 
-      ui8_state_temp_field = 1;
+    if (configuration_variables.ui8_throttle_adc_measures_motor_temperature)
+    {
+      if (configuration_variables.ui8_temperature_field_config > 2) { configuration_variables.ui8_temperature_field_config = 0; }
+    }
+    else
+    {
+      if (configuration_variables.ui8_temperature_field_config > 1) { configuration_variables.ui8_temperature_field_config = 0; }
     }
   }
-  else
+
+  // change to next configuration profile: ONOFF + DOWN long click event
+  if (get_button_onoff_down_long_click_event ())
   {
-    ui8_state_temp_field = 0;
+    clear_button_onoff_down_long_click_event ();
+
+    if (ui8_lcd_menu == 0)
+    {
+      eeprom_profile_select ((configuration_variables.ui8_profile + 1) % EEPROM_PROFILES);
+
+      // send all the configurations to the motor controller again
+      uart_resend_configurations ();
+
+      // show the profile number for 2 seconds
+      ui8_profile_show_counter = 200;
+    }
   }
 
-  calc_battery_soc_watts_hour ();
+  calc_battery_soc ();
 
   switch (ui8_lcd_menu)
   {
@@ -240,7 +409,7 @@ void clock_lcd (void)
   low_pass_filter_battery_voltage_current_power ();
   low_pass_filter_pedal_torque ();
   calc_wh ();
-  calc_odometer ();
+  range_update ();
   automatic_power_off_management ();
 
   lcd_update ();
@@ -253,7 +422,17 @@ void lcd_execute_main_screen (void)
 {
   temperature ();
   assist_level_state ();
-  odometer ();
+
+  if (ui8_profile_show_counter)
+  {
+    ui8_profile_show_counter--;
+    lcd_print (configuration_variables.ui8_profile, ODOMETER_FIELD, 1);
+  }
+  else
+  {
+    odometer ();
+  }
+
   wheel_speed ();
   walk_assist_state ();
   offroad_mode ();
@@ -301,1081 +480,34 @@ void lcd_execute_menu_config (void)
   }
   // ui8_lcd_menu_config_submenu_active == 1
   else
-  {
-    switch (ui8_lcd_menu_config_submenu_number)
-    {
-      case 0:
-        lcd_execute_menu_config_submenu_wheel_config ();
-      break;
-
-      case 1:
-        lcd_execute_menu_config_submenu_battery ();
-      break;
-
-      case 2:
-        lcd_execute_menu_config_submenu_battery_soc ();
-      break;
-
-      case 3:
-        lcd_execute_menu_config_submenu_assist_level ();
-      break;
-
-      case 4:
-        lcd_execute_menu_config_submenu_motor_startup_power_boost ();
-      break;
-
-      case 5:
-        lcd_execute_menu_config_submenu_motor_temperature ();        
-      break;
-
-      case 6:
-        lcd_execute_menu_config_submenu_lcd ();
-      break;
-
-      case 7:
-        lcd_execute_menu_config_submenu_offroad_mode ();
-      break;
-
-      case 8:
-        lcd_execute_menu_config_submenu_various ();
-      break;
-
-      case 9:
-        lcd_execute_menu_config_submenu_technical ();
-      break;
-
-      default:
-        ui8_lcd_menu_config_submenu_number = 0;
-      break;
-    }
-
-    // leave config menu with a button_onoff_long_click
-    if (get_button_onoff_long_click_event ())
-    {
-      clear_button_onoff_long_click_event ();
-
-      ui8_lcd_menu_config_submenu_active = 0;
-      ui8_lcd_menu_config_submenu_state = 0;
-    }
-  }
-}
-
-void lcd_execute_menu_config_submenu_wheel_config (void)
-{
-  // advance on submenus on button_onoff_click_event
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 3);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    // menu to choose max wheel speed
-    case 0:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-
-        configuration_variables.ui8_wheel_max_speed++;
-        if (configuration_variables.ui8_wheel_max_speed >= 99) { configuration_variables.ui8_wheel_max_speed = 99; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-
-        configuration_variables.ui8_wheel_max_speed--;
-        if (configuration_variables.ui8_wheel_max_speed < 1)  { configuration_variables.ui8_wheel_max_speed = 1; }
-
-      }
-
-      // print wheel speed only half of the time
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (((uint16_t) configuration_variables.ui8_wheel_max_speed) * 10, WHEEL_SPEED_FIELD, 0);
-      }
-
-      lcd_enable_kmh_symbol (1);
-    break;
-
-    // menu to choose wheel perimeter
-    case 1:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-
-        configuration_variables.ui16_wheel_perimeter += 10;
-        // max value is 3000 mm
-        if (configuration_variables.ui16_wheel_perimeter >= 3000) { configuration_variables.ui16_wheel_perimeter = 3000; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-
-        configuration_variables.ui16_wheel_perimeter -= 10;
-        // min value is 750 mm
-        if (configuration_variables.ui16_wheel_perimeter < 750) { configuration_variables.ui16_wheel_perimeter = 750; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui16_wheel_perimeter, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // menu to choose Km/h or MP/h
-    case 2:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-
-        configuration_variables.ui8_units_type++;
-        if (configuration_variables.ui8_units_type > 1) { configuration_variables.ui8_units_type = 1; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-
-        configuration_variables.ui8_units_type--;
-        if (configuration_variables.ui8_units_type != 0) { configuration_variables.ui8_units_type = 0; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        if (configuration_variables.ui8_units_type)
-          lcd_enable_mph_symbol (1);
-        else
-          lcd_enable_kmh_symbol (1);
-      }
-    break;
-  }
-}
-
-void lcd_execute_menu_config_submenu_battery (void)
-{
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 4);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    // battery max current
-    case 0:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-
-        configuration_variables.ui8_battery_max_current++;
-        if (configuration_variables.ui8_battery_max_current > 100) { configuration_variables.ui8_battery_max_current = 100; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-
-        if (configuration_variables.ui8_battery_max_current > 0)
-          configuration_variables.ui8_battery_max_current--;
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_battery_max_current, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // battery low voltage cut-off
-    case 1:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui16_battery_low_voltage_cut_off_x10 < 630) { configuration_variables.ui16_battery_low_voltage_cut_off_x10++; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui16_battery_low_voltage_cut_off_x10 > 161) { configuration_variables.ui16_battery_low_voltage_cut_off_x10--; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui16_battery_low_voltage_cut_off_x10, ODOMETER_FIELD, 0);
-      }
-    break;
-
-    // battery cells number
-    case 2:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui8_battery_cells_number < 15) { configuration_variables.ui8_battery_cells_number++; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui8_battery_cells_number > 7) { configuration_variables.ui8_battery_cells_number--; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_battery_cells_number, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // battery pack resistance
-    case 3:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui16_battery_pack_resistance_x1000 < 1001) { configuration_variables.ui16_battery_pack_resistance_x1000++; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui16_battery_pack_resistance_x1000 > 0) { configuration_variables.ui16_battery_pack_resistance_x1000--; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui16_battery_pack_resistance_x1000, ODOMETER_FIELD, 1);
-      }
-    break;
-  }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-}
-
-void lcd_execute_menu_config_submenu_battery_soc (void)
-{
-  uint8_t ui8_temp;
-
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 5);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    // menu to enable/disable show of numeric watts hour value
-    case 0:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_show_numeric_battery_soc |= 1;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_show_numeric_battery_soc &= ~1;
-      }
-
-      ui8_temp = ((configuration_variables.ui8_show_numeric_battery_soc & 1) ? 1 : 0);
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (ui8_temp, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // menu to enable/disable show of numeric watts hour value in incrementing or decementing percentage
-    case 1:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_show_numeric_battery_soc |= 2;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_show_numeric_battery_soc &= ~2;
-      }
-
-      ui8_temp = ((configuration_variables.ui8_show_numeric_battery_soc & 2) ? 1 : 0);
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (ui8_temp, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // battery_voltage_reset_wh_counter
-    case 2:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui16_battery_voltage_reset_wh_counter_x10 < 630) { configuration_variables.ui16_battery_voltage_reset_wh_counter_x10++; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui16_battery_voltage_reset_wh_counter_x10 > 161) { configuration_variables.ui16_battery_voltage_reset_wh_counter_x10--; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui16_battery_voltage_reset_wh_counter_x10, ODOMETER_FIELD, 0);
-      }
-    break;
-
-    // menu to choose watts hour value to be equal to 100% of battery SOC
-    case 3:
-      if (get_button_up_click_event ())
-      {
-        button_clear_events ();
-
-        // increment at 10 units
-        configuration_variables.ui32_wh_x10_100_percent += 100;
-        if (configuration_variables.ui32_wh_x10_100_percent > 99900) { configuration_variables.ui32_wh_x10_100_percent = 99900; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        button_clear_events ();
-
-        configuration_variables.ui32_wh_x10_100_percent -= 100;
-        if (configuration_variables.ui32_wh_x10_100_percent < 100) { configuration_variables.ui32_wh_x10_100_percent = 0; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui32_wh_x10_100_percent, ODOMETER_FIELD, 0);
-      }
-    break;
-
-    // menu to set current watts hour value
-    case 4:
-      // on the very first time, use current value of ui32_wh_x10
-      if (ui8_config_wh_x10_offset)
-      {
-        ui8_config_wh_x10_offset = 0;
-        configuration_variables.ui32_wh_x10_offset = ui32_wh_x10;
-      }
-      // keep reseting this values
-      ui32_wh_sum_x5 = 0;
-      ui32_wh_sum_counter = 0;
-      ui32_wh_x10 = 0;
-
-      if (get_button_up_click_event ())
-      {
-        button_clear_events ();
-
-        // increment at 10 units
-        configuration_variables.ui32_wh_x10_offset += 100;
-        if (configuration_variables.ui32_wh_x10_offset > 99900) { configuration_variables.ui32_wh_x10_offset = 99900; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        button_clear_events ();
-
-        if (configuration_variables.ui32_wh_x10_offset > 100)
-        {
-          configuration_variables.ui32_wh_x10_offset -= 100;
-        }
-        else if (configuration_variables.ui32_wh_x10_offset > 0)
-        {
-          configuration_variables.ui32_wh_x10_offset = 0;
-        }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui32_wh_x10_offset, ODOMETER_FIELD, 0);
-      }
-    break;
-  }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-}
-
-void lcd_execute_menu_config_submenu_assist_level (void)
-{
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, (configuration_variables.ui8_number_of_assist_levels + 1));
-
-  // number of assist levels: 0 to 9
-  if (ui8_lcd_menu_config_submenu_state == 0)
-  {
-    if (get_button_up_click_event ())
-    {
-      clear_button_up_click_event ();
-      if (configuration_variables.ui8_number_of_assist_levels < 9) { configuration_variables.ui8_number_of_assist_levels++; }
-    }
-
-    if (get_button_down_click_event ())
-    {
-      clear_button_down_click_event ();
-      if (configuration_variables.ui8_number_of_assist_levels > 1) { configuration_variables.ui8_number_of_assist_levels--; }
-    }
-
-    if (ui8_lcd_menu_flash_state)
-    {
-      lcd_print (configuration_variables.ui8_number_of_assist_levels, ODOMETER_FIELD, 1);
-    }
-  }
-  // value of each assist level
-  else
-  {
-    if (get_button_up_click_event ())
-    {
-      clear_button_up_click_event ();
-      configuration_variables.ui8_assist_level_power [(ui8_lcd_menu_config_submenu_state - 1)]++;
-    }
-
-    if (get_button_down_click_event ())
-    {
-      clear_button_down_click_event ();
-      configuration_variables.ui8_assist_level_power [(ui8_lcd_menu_config_submenu_state - 1)]--;
-    }
-
-    if (ui8_lcd_menu_flash_state)
-    {
-      lcd_print (configuration_variables.ui8_assist_level_power [ui8_lcd_menu_config_submenu_state - 1] * 25, ODOMETER_FIELD, 1);
-    }
-  }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-}
-
-void lcd_execute_menu_config_submenu_motor_startup_power_boost (void)
-{
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, (configuration_variables.ui8_number_of_assist_levels + 4));
-
-  // enable or disable
-  if (ui8_lcd_menu_config_submenu_state == 0)
-  {
-    if (get_button_up_click_event ())
-    {
-      clear_button_up_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_state |= 1;
-    }
-
-    if (get_button_down_click_event ())
-    {
-      clear_button_down_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_state &= ~1;
-    }
-
-    if (ui8_lcd_menu_flash_state)
-    {
-      lcd_print ((configuration_variables.ui8_startup_motor_power_boost_state & 1) ? 1: 0, ODOMETER_FIELD, 1);
-    }
-  }
-  // limit to max power
-  else if (ui8_lcd_menu_config_submenu_state == 1)
-  {
-    if (get_button_up_click_event ())
-    {
-      clear_button_up_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_state |= 2;
-    }
-
-    if (get_button_down_click_event ())
-    {
-      clear_button_down_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_state &= ~2;
-    }
-
-    if (ui8_lcd_menu_flash_state)
-    {
-      lcd_print ((configuration_variables.ui8_startup_motor_power_boost_state & 2) ? 1: 0, ODOMETER_FIELD, 1);
-    }
-  }
-  // startup motor power boost time
-  else if (ui8_lcd_menu_config_submenu_state == 2)
-  {
-    if (get_button_up_click_event ())
-    {
-      clear_button_up_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_time++;
-    }
-
-    if (get_button_down_click_event ())
-    {
-      clear_button_down_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_time--;
-    }
-
-    if (ui8_lcd_menu_flash_state)
-    {
-      lcd_print (configuration_variables.ui8_startup_motor_power_boost_time, ODOMETER_FIELD, 0);
-    }
-  }
-  // startup motor power boost fade time
-  else if (ui8_lcd_menu_config_submenu_state == 3)
-  {
-    if (get_button_up_click_event ())
-    {
-      clear_button_up_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_fade_time++;
-    }
-
-    if (get_button_down_click_event ())
-    {
-      clear_button_down_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost_fade_time--;
-    }
-
-    if (ui8_lcd_menu_flash_state)
-    {
-      lcd_print (configuration_variables.ui8_startup_motor_power_boost_fade_time, ODOMETER_FIELD, 0);
-    }
-  }
-  // value of each assist level power boost
-  else
-  {
-    if (get_button_up_click_event ())
-    {
-      clear_button_up_click_event ();
-      // the BATTERY_POWER_FIELD can't show higher value
-      configuration_variables.ui8_startup_motor_power_boost [(ui8_lcd_menu_config_submenu_state - 4)]++;
-    }
-
-    if (get_button_down_click_event ())
-    {
-      clear_button_down_click_event ();
-      configuration_variables.ui8_startup_motor_power_boost [(ui8_lcd_menu_config_submenu_state - 4)]--;
-    }
-
-    if (ui8_lcd_menu_flash_state)
-    {
-      lcd_print (configuration_variables.ui8_startup_motor_power_boost [ui8_lcd_menu_config_submenu_state - 4] * 25, ODOMETER_FIELD, 1);
-    }
-  }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-}
-
-void lcd_execute_menu_config_submenu_motor_temperature (void)
-{
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 3);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    // motor temperature enable
-    case 0:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_throttle_adc_measures_motor_temperature = 1;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_throttle_adc_measures_motor_temperature = 0;
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_throttle_adc_measures_motor_temperature, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // motor temperature limit min
-    case 1:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui8_motor_temperature_min_value_to_limit < 110)
-        {
-          configuration_variables.ui8_motor_temperature_min_value_to_limit++;
-        }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui8_motor_temperature_min_value_to_limit > 0)
-        {
-          configuration_variables.ui8_motor_temperature_min_value_to_limit--;
-        }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_motor_temperature_min_value_to_limit, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // motor temperature limit max
-    case 2:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui8_motor_temperature_max_value_to_limit < 110)
-        {
-          configuration_variables.ui8_motor_temperature_max_value_to_limit++;
-        }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui8_motor_temperature_max_value_to_limit > 0)
-        {
-          configuration_variables.ui8_motor_temperature_max_value_to_limit--;
-        }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_motor_temperature_max_value_to_limit, ODOMETER_FIELD, 1);
-      }
-    break;
-  }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-}
-
-void lcd_execute_menu_config_submenu_lcd (void)
-{
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 4);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    // backlight off brightness
-    case 0:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui8_lcd_backlight_off_brightness < 20)
-        {
-          configuration_variables.ui8_lcd_backlight_off_brightness++;
-        }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui8_lcd_backlight_off_brightness > 0)
-        {
-          configuration_variables.ui8_lcd_backlight_off_brightness--;
-        }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        // * 5 to show a value from 0 to 100% in steps of 5%
-        lcd_print (configuration_variables.ui8_lcd_backlight_off_brightness * 5, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // backlight on brightness
-    case 1:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        if (configuration_variables.ui8_lcd_backlight_on_brightness < 20)
-        {
-          configuration_variables.ui8_lcd_backlight_on_brightness++;
-        }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (configuration_variables.ui8_lcd_backlight_on_brightness > 0)
-        {
-          configuration_variables.ui8_lcd_backlight_on_brightness--;
-        }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        // * 5 to show a value from 0 to 100% in steps of 5%
-        lcd_print (configuration_variables.ui8_lcd_backlight_on_brightness * 5, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // auto power off
-    case 2:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_lcd_power_off_time_minutes++;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_lcd_power_off_time_minutes--;
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_lcd_power_off_time_minutes, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // reset to defaults
-    case 3:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-
-        ui8_reset_to_defaults_counter++;
-        if (ui8_reset_to_defaults_counter > 9)
-        {
-          eeprom_erase_key_value ();
-          // disables the power of LCD
-          GPIO_WriteLow(LCD3_ONOFF_POWER__PORT, LCD3_ONOFF_POWER__PIN);
-        }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (ui8_reset_to_defaults_counter > 0)
-        {
-          ui8_reset_to_defaults_counter--;
-        }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (ui8_reset_to_defaults_counter, ODOMETER_FIELD, 1);
-      }
-    break;
-  }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-}
-
-void lcd_execute_menu_config_submenu_offroad_mode (void)
-{
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 5);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    // enable/disable offroad functionality
-    case 0:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_offroad_func_enabled |= 1;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_offroad_func_enabled &= ~1;
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print ((configuration_variables.ui8_offroad_func_enabled & 1) ? 1: 0, ODOMETER_FIELD, 1);
-      }
-
-      lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-    break;
-
-    // enable offroad mode on system startup
-    case 1:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_offroad_enabled_on_startup |= 1;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_offroad_enabled_on_startup &= ~1;
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print ((configuration_variables.ui8_offroad_enabled_on_startup & 1) ? 1: 0, ODOMETER_FIELD, 1);
-      }
-
-      lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-    break;
-
-    // offroad speed limit (when offroad mode is off)
-    case 2:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_offroad_speed_limit++;
-        if (configuration_variables.ui8_offroad_speed_limit > 99)  { configuration_variables.ui8_offroad_speed_limit = 99; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_offroad_speed_limit--;
-        if (configuration_variables.ui8_offroad_speed_limit < 1)  { configuration_variables.ui8_offroad_speed_limit = 1; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (((uint16_t) configuration_variables.ui8_offroad_speed_limit) * 10, WHEEL_SPEED_FIELD, 0);
-      }
-
-      lcd_enable_kmh_symbol (1);
-    break;
-
-    // enable/disable power limit
-    case 3:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_offroad_power_limit_enabled |= 1;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_offroad_power_limit_enabled &= ~1;
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print ((configuration_variables.ui8_offroad_power_limit_enabled & 1) ? 1: 0, ODOMETER_FIELD, 1);
-      }
-
-      lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-    break;
-
-    // power limit (W)
-    case 4:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_offroad_power_limit_div25++;
-        if (configuration_variables.ui8_offroad_power_limit_div25 > 40)  { configuration_variables.ui8_offroad_power_limit_div25 = 40; }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_offroad_power_limit_div25--;
-        if (configuration_variables.ui8_offroad_power_limit_div25 < 4)  { configuration_variables.ui8_offroad_power_limit_div25 = 4; }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_offroad_power_limit_div25 * 25, ODOMETER_FIELD, 1);
-      }
-
-      lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-    break;
-  }
-}
-
-void lcd_execute_menu_config_submenu_various (void)
-{
-  uint8_t ui8_temp;
-
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 4);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    // motor voltage type
-    case 0:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_motor_voltage_type |= 1;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_motor_voltage_type &= ~1;
-      }
-
-      ui8_temp = ((configuration_variables.ui8_motor_voltage_type & 1) ? 1 : 0);
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (ui8_temp, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // motor assistance startup without pedal rotation
-    case 1:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_motor_assistance_startup_without_pedal_rotation |= 1;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_motor_assistance_startup_without_pedal_rotation &= ~1;
-      }
-
-      ui8_temp = ((configuration_variables.ui8_motor_assistance_startup_without_pedal_rotation & 1) ? 1 : 0);
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (ui8_temp, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // PAS max cadence
-    case 2:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-        configuration_variables.ui8_pas_max_cadence++;
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        configuration_variables.ui8_pas_max_cadence--;
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (configuration_variables.ui8_pas_max_cadence, ODOMETER_FIELD, 1);
-      }
-    break;
-
-    // Reset trip distance and total trip distance
-    case 3:
-      if (get_button_up_click_event ())
-      {
-        clear_button_up_click_event ();
-
-        ui8_reset_to_defaults_counter++;
-        if (ui8_reset_to_defaults_counter > 9)
-        {
-          configuration_variables.ui32_odometer_x10 = 0;
-          configuration_variables.ui16_odometer_distance_x10 = 0;
-          ui8_reset_to_defaults_counter = 0;
-        }
-      }
-
-      if (get_button_down_click_event ())
-      {
-        clear_button_down_click_event ();
-        if (ui8_reset_to_defaults_counter > 0)
-        {
-          ui8_reset_to_defaults_counter--;
-        }
-      }
-
-      if (ui8_lcd_menu_flash_state)
-      {
-        lcd_print (ui8_reset_to_defaults_counter, ODOMETER_FIELD, 1);
-      }
-    break;
-  }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
-}
-
-void lcd_execute_menu_config_submenu_technical (void)
-{
-  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, 9);
-
-  switch (ui8_lcd_menu_config_submenu_state)
-  {
-    case 0:
-      lcd_print (motor_controller_data.ui8_adc_throttle, ODOMETER_FIELD, 1);
-    break;
-
-    case 1:
-      lcd_print (motor_controller_data.ui8_throttle, ODOMETER_FIELD, 1);
-    break;
-
-    case 2:
-      lcd_print (motor_controller_data.ui8_adc_pedal_torque_sensor, ODOMETER_FIELD, 1);
-    break;
-
-    case 3:
-      lcd_print (motor_controller_data.ui8_pedal_torque_sensor, ODOMETER_FIELD, 1);
-    break;
-
-    case 4:
-      lcd_print (motor_controller_data.ui8_pedal_cadence, ODOMETER_FIELD, 1);
-    break;
-
-    case 5:
-      lcd_print (motor_controller_data.ui8_pedal_human_power, ODOMETER_FIELD, 1);
-    break;
-
-    case 6:
-      lcd_print (motor_controller_data.ui8_duty_cycle, ODOMETER_FIELD, 1);
-    break;
-
-    case 7:
-      lcd_print (motor_controller_data.ui16_motor_speed_erps, ODOMETER_FIELD, 1);
-    break;
+  {
+    lcd_execute_menu_config_submenu ();
 
-    case 8:
-      lcd_print (motor_controller_data.ui8_foc_angle, ODOMETER_FIELD, 1);
-    break;
+    // leave config menu with a button_onoff_long_click
+    if (get_button_onoff_long_click_event ())
+    {
+      clear_button_onoff_long_click_event ();
 
-//    // pedal torque in Nm
-//    case 3:
-//      lcd_print (ui32_torque_sensor_force_x1000 / 1000, ODOMETER_FIELD, 1);
-//      lcd_enable_vol_symbol (0);
-//    break;
-//
-//    // pedal power in watts
-//    case 4:
-//      lcd_print (ui32_torque_accumulated_filtered_x10 / 10, ODOMETER_FIELD, 1);
-//      lcd_enable_vol_symbol (0);
-//    break;
+      ui8_lcd_menu_config_submenu_active = 0;
+      ui8_lcd_menu_config_submenu_state = 0;
+      p_menu_edit_digits_value = 0;
+    }
   }
-
-  lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
 }
 
 void lcd_execute_menu_config_power (void)
 {
-  // because this click envent can happens and will block the detection of button_onoff_long_click_event
-  clear_button_onoff_click_event ();
-
   // leave this menu with a button_onoff_long_click
   if (get_button_onoff_long_click_event ())
   {
-    button_clear_events ();
+    clear_button_onoff_long_click_event ();
     ui8_lcd_menu = 0;
 
     // save the updated variables on EEPROM
     eeprom_write_variables ();
   }
 
-  if (get_button_up_click_event ())
-  {
-    button_clear_events ();
-
-    if (configuration_variables.ui8_target_max_battery_power < 10)
-    {
-      configuration_variables.ui8_target_max_battery_power++;
-    }
-    else
-    {
-      configuration_variables.ui8_target_max_battery_power += 2;
-    }
-
-    // the BATTERY_POWER_FIELD can't show higher value
-    if (configuration_variables.ui8_target_max_battery_power > 190) { configuration_variables.ui8_target_max_battery_power = 190; }
-  }
-
-  if (get_button_down_click_event ())
-  {
-    button_clear_events ();
-
-    if (configuration_variables.ui8_target_max_battery_power == 0)
-    {
-
-    }
-    else if (configuration_variables.ui8_target_max_battery_power <= 10)
-    {
-      configuration_variables.ui8_target_max_battery_power--;
-    }
-    else
-    {
-      configuration_variables.ui8_target_max_battery_power -= 2;
-    }
-  }
-
-  if (ui8_lcd_menu_flash_state)
-  {
-    lcd_print (configuration_variables.ui8_target_max_battery_power * 25, BATTERY_POWER_FIELD, 0);
-  }
+  menu_execute_item (&menu_item_target_max_battery_power, 0);
 }
 
 uint8_t first_time_management (void)
@@ -1394,8 +526,7 @@ uint8_t first_time_management (void)
     ui8_motor_controller_init = 0;
 
     // reset Wh value if battery voltage is over ui16_battery_voltage_reset_wh_counter_x10 (value configured by user)
-    if (((uint32_t) motor_controller_data.ui16_adc_battery_voltage *
-        ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000) > ((uint32_t) configuration_variables.ui16_battery_voltage_reset_wh_counter_x10 * 1000))
+    if (motor_controller_data.ui16_adc_battery_voltage > derived_values.ui16_adc_battery_voltage_reset_wh_counter)
     {
       configuration_variables.ui32_wh_x10_offset = 0;
     }
@@ -1436,9 +567,9 @@ void temperature (void)
       case 0:
       break;
 
-      // show battery_soc_watts_hour
+      // show battery state of charge
       case 1:
-        lcd_print (ui16_battery_soc_watts_hour, TEMPERATURE_FIELD, 0);
+        lcd_print (ui16_battery_soc, TEMPERATURE_FIELD, 0);
       break;
 
       // show motor temperature
@@ -1452,32 +583,19 @@ void temperature (void)
 
 void battery_soc (void)
 {
-  static uint8_t ui8_timmer_counter;
-  static uint8_t ui8_battery_state_of_charge;
-  uint8_t ui8_battery_cells_number_x10;
-  uint16_t ui16_battery_voltage_x10;
-  uint16_t ui16_fluctuate_battery_voltage_x10;
-
-  // update battery level value only at every 100ms / 10 times per second and this helps to visual filter the fast changing values
-  if (ui8_timmer_counter++ >= 10)
-  {
-    ui8_timmer_counter = 0;
-
-    // calculate flutuate voltage, that depends on the current and battery pack resistance
-    ui16_fluctuate_battery_voltage_x10 = (uint16_t) ((((uint32_t) configuration_variables.ui16_battery_pack_resistance_x1000) * ((uint32_t) ui16_battery_current_filtered_x5)) / ((uint32_t) 500));
-    // now add fluctuate voltage value
-    ui16_battery_voltage_x10 = ui16_battery_voltage_filtered_x10 + ui16_fluctuate_battery_voltage_x10;
+  uint8_t ui8_battery_state_of_charge;
+  uint8_t ui8_i;
+  uint16_t ui16_battery_soc_x10;
 
-    // to keep same scale as voltage of x10
-    ui8_battery_cells_number_x10 = configuration_variables.ui8_battery_cells_number * 10;
+  // same state of charge as the numeric value, see battery_soc_update ()
+  ui16_battery_soc_x10 = battery_soc_get_x10 ();
 
-    if (ui16_battery_voltage_x10 > ((uint16_t) ((float) ui8_battery_cells_number_x10 * LI_ION_CELL_VOLTS_80))) { ui8_battery_state_of_charge = 5; } // 4 bars | full
-    else if (ui16_battery_voltage_x10 > ((uint16_t) ((float) ui8_battery_cells_number_x10 * LI_ION_CELL_VOLTS_60))) { ui8_battery_state_of_charge = 4; } // 3 bars
-    else if (ui16_battery_voltage_x10 > ((uint16_t) ((float) ui8_battery_cells_number_x10 * LI_ION_CELL_VOLTS_40))) { ui8_battery_state_of_charge = 3; } // 2 bars
-    else if (ui16_battery_voltage_x10 > ((uint16_t) ((float) ui8_battery_cells_number_x10 * LI_ION_CELL_VOLTS_20))) { ui8_battery_state_of_charge = 2; } // 1 bar
-    else if (ui16_battery_voltage_x10 > ((uint16_t) ((float) ui8_battery_cells_number_x10 * LI_ION_CELL_VOLTS_10))) { ui8_battery_state_of_charge = 1; } // empty
-    else { ui8_battery_state_of_charge = 0; } // flashing
+  // 5 = 4 bars | full; 4 = 3 bars; 3 = 2 bars; 2 = 1 bar; 1 = empty; 0 = flashing
+  for (ui8_i = 0; ui8_i < BATTERY_SOC_THRESHOLDS_NUMBER; ui8_i++)
+  {
+    if (ui16_battery_soc_x10 > ui16_battery_soc_threshold_x10 [ui8_i]) { break; }
   }
+  ui8_battery_state_of_charge = BATTERY_SOC_THRESHOLDS_NUMBER - ui8_i;
 
   /*
     ui8_lcd_frame_buffer[23] |= 16;  // empty
@@ -1526,7 +644,10 @@ void power (void)
 {
   lcd_print (ui16_battery_power_filtered, BATTERY_POWER_FIELD, 0);
   lcd_enable_motor_symbol (1);
-  lcd_enable_w_symbol (1);
+
+  // the LCD has no W symbol on the odometer field, this one flashes when the odometer field shows the trip average power
+  lcd_enable_w_symbol ((configuration_variables.ui8_odometer_field_state != 12) || ui8_profile_show_counter ||
+      ui8_lcd_menu_flash_state);
 }
 
 void assist_level_state (void)
@@ -1584,6 +705,12 @@ void lights_state (void)
 void walk_assist_state (void)
 {
   if (get_button_down_long_click_event ())
+  {
+    clear_button_down_long_click_event ();
+    ui8_walk_assist_state = 1;
+  }
+
+  if (ui8_walk_assist_state)
   {
     // user need to keep pressing the button to have walk assist
     if (get_button_down_state ())
@@ -1594,7 +721,7 @@ void walk_assist_state (void)
     else
     {
       motor_controller_data.ui8_walk_assist_level = 0;
-      clear_button_down_long_click_event ();
+      ui8_walk_assist_state = 0;
     }
   }
 }
@@ -1603,15 +730,15 @@ void offroad_mode (void)
 {
   if (configuration_variables.ui8_offroad_func_enabled) 
   {
-    if (get_button_onoff_state () && get_button_up_state ())
+    if (get_button_onoff_up_click_event ())
     {
-      button_clear_events ();
+      clear_button_onoff_up_click_event ();
       motor_controller_data.ui8_offroad_mode = 1;
     }
 
-    if (get_button_onoff_state () && get_button_down_state ())
+    if (get_button_onoff_down_click_event ())
     {
-      button_clear_events ();
+      clear_button_onoff_down_click_event ();
       motor_controller_data.ui8_offroad_mode = 0;
     }
 
@@ -1636,13 +763,18 @@ void brake (void)
 
 void odometer_increase_field_state (void)
 {
-  configuration_variables.ui8_odometer_field_state = (configuration_variables.ui8_odometer_field_state + 1) % 8;
+  configuration_variables.ui8_odometer_field_state = (configuration_variables.ui8_odometer_field_state + 1) % 16;
 }
 
-void odometer (void)
+// hours * 100 + minutes, to be shown as hh:mm
+static uint32_t seconds_to_hours_minutes (uint32_t ui32_seconds)
 {
-  uint32_t uint32_temp;
+  uint32_t ui32_minutes = ui32_seconds / 60;
+  return ((ui32_minutes / 60) * 100) + (ui32_minutes % 60);
+}
 
+void odometer (void)
+{
   // odometer values
   if (get_button_onoff_click_event ())
   {
@@ -1650,6 +782,14 @@ void odometer (void)
     odometer_increase_field_state ();
   }
 
+  // ONOFF has double click for the configuration menus, here it is just two clicks
+  if (button_event_is (BUTTON_ONOFF, BUTTON_EVENT_DOUBLE_CLICK))
+  {
+    button_event_consume ();
+    odometer_increase_field_state ();
+    odometer_increase_field_state ();
+  }
+
   switch (configuration_variables.ui8_odometer_field_state)
   {
     // DST Single Trip Distance OR
@@ -1659,10 +799,9 @@ void odometer (void)
       lcd_enable_km_symbol (1);
     break;
 
-    // ODO Total Trip Distance
+    // ODO Total Trip Distance, it is updated together with the single trip distance, see odometer_update ()
     case 1:
-      uint32_temp = configuration_variables.ui32_odometer_x10 + ((uint32_t) configuration_variables.ui16_odometer_distance_x10);
-      lcd_print (uint32_temp, ODOMETER_FIELD, 0);
+      lcd_print (configuration_variables.ui32_odometer_x10, ODOMETER_FIELD, 0);
       lcd_enable_odo_symbol (1);
       lcd_enable_km_symbol (1);
     break;
@@ -1692,7 +831,7 @@ void odometer (void)
     case 6:
       if (configuration_variables.ui8_show_numeric_battery_soc & 1)
       {
-        lcd_print (ui16_battery_soc_watts_hour, ODOMETER_FIELD, 1);
+        lcd_print (ui16_battery_soc, ODOMETER_FIELD, 1);
       }
       else
       {
@@ -1712,6 +851,67 @@ void odometer (void)
       }
     break;
 
+    // AVS trip average speed
+    case 8:
+      lcd_print ((trip_get_average_speed_x10 () * derived_values.ui8_speed_factor_x8) >> 3, ODOMETER_FIELD, 0);
+      lcd_enable_avs_symbol (1);
+    break;
+
+    // MXS trip max speed
+    case 9:
+      lcd_print ((configuration_variables.ui16_trip_max_speed_x10 * derived_values.ui8_speed_factor_x8) >> 3, ODOMETER_FIELD, 0);
+      lcd_enable_mxs_symbol (1);
+    break;
+
+    // TM trip moving time, hours:minutes
+    case 10:
+      lcd_print (seconds_to_hours_minutes (configuration_variables.ui32_trip_moving_time_seconds), ODOMETER_FIELD, 1);
+      lcd_enable_tm_symbol (1);
+      lcd_enable_timer_colon_symbol (1);
+    break;
+
+    // TTM trip total time, hours:minutes
+    case 11:
+      lcd_print (seconds_to_hours_minutes (configuration_variables.ui32_trip_total_time_seconds), ODOMETER_FIELD, 1);
+      lcd_enable_ttm_symbol (1);
+      lcd_enable_timer_colon_symbol (1);
+    break;
+
+    // trip average power: AVS and the W symbol flashing, see power ()
+    case 12:
+      lcd_print (trip_get_average_power (), ODOMETER_FIELD, 1);
+      lcd_enable_avs_symbol (1);
+    break;
+
+    // efficiency, Wh/km (or Wh/mile) over the last kms: VOL and km (or mil), the LCD has no Wh symbol here
+    case 13:
+      lcd_print ((((uint32_t) range_get_wh_km_x10 ()) << 3) / derived_values.ui8_speed_factor_x8, ODOMETER_FIELD, 0);
+      lcd_enable_vol_symbol (1);
+      lcd_enable_distance_unit_symbol (1);
+    break;
+
+    // trip average efficiency, Wh/km (or Wh/mile): AVS, VOL and km (or mil)
+    case 14:
+      lcd_print ((((uint32_t) range_get_trip_wh_km_x10 ()) << 3) / derived_values.ui8_speed_factor_x8, ODOMETER_FIELD, 0);
+      lcd_enable_avs_symbol (1);
+      lcd_enable_vol_symbol (1);
+      lcd_enable_distance_unit_symbol (1);
+    break;
+
+    // remaining range, only when the battery 100 % Wh is configured: km (or mil) flashing, as it is an estimate,
+    // so it is not taken for the trip distance
+    case 15:
+      if (configuration_variables.ui32_wh_x10_100_percent)
+      {
+        lcd_print ((((uint32_t) range_get_remaining_km_x10 ()) * derived_values.ui8_speed_factor_x8) >> 3, ODOMETER_FIELD, 0);
+        lcd_enable_distance_unit_symbol (ui8_lcd_menu_flash_state);
+      }
+      else
+      {
+        odometer_increase_field_state ();
+      }
+    break;
+
     default:
     configuration_variables.ui8_odometer_field_state = 0;
     break;
@@ -1720,14 +920,20 @@ void odometer (void)
 
 void wheel_speed (void)
 {
+  uint16_t ui16_wheel_speed_x10;
+
+  // wheel speed estimated from the wheel speed sensor ticks, see odometer_speed_update ()
+  ui16_wheel_speed_x10 = odometer_get_speed_x10 ();
+
   if (configuration_variables.ui8_units_type)
   {
-    lcd_print (((float) motor_controller_data.ui16_wheel_speed_x10 / 1.6), WHEEL_SPEED_FIELD, 0);
+    // + 4 to round to the nearest 0.1 mph
+    lcd_print ((((uint32_t) ui16_wheel_speed_x10) * derived_values.ui8_speed_factor_x8 + 4) >> 3, WHEEL_SPEED_FIELD, 0);
     lcd_enable_mph_symbol (1);
   }
   else
   {
-    lcd_print (motor_controller_data.ui16_wheel_speed_x10, WHEEL_SPEED_FIELD, 0);
+    lcd_print (ui16_wheel_speed_x10, WHEEL_SPEED_FIELD, 0);
     lcd_enable_kmh_symbol (1);
   }
 }
@@ -1955,6 +1161,13 @@ void lcd_enable_km_symbol (uint8_t ui8_state)
     ui8_lcd_frame_buffer[4] &= ~8;
 }
 
+// km or mil symbol, for the configured units
+void lcd_enable_distance_unit_symbol (uint8_t ui8_state)
+{
+  if (configuration_variables.ui8_units_type) { lcd_enable_mil_symbol (ui8_state); }
+  else { lcd_enable_km_symbol (ui8_state); }
+}
+
 void lcd_enable_mil_symbol (uint8_t ui8_state)
 {
   if (ui8_state)
@@ -2099,17 +1312,22 @@ void lcd_enable_ttm_symbol (uint8_t ui8_state)
     ui8_lcd_frame_buffer[17] &= ~32;
 }
 
+void lcd_enable_timer_colon_symbol (uint8_t ui8_state)
+{
+  if (ui8_state)
+    ui8_lcd_frame_buffer[23] |= 8;
+  else
+    ui8_lcd_frame_buffer[23] &= ~8;
+}
+
 void low_pass_filter_battery_voltage_current_power (void)
 {
   // low pass filter battery voltage
-  ui32_battery_voltage_accumulated_x10000 -= ui32_battery_voltage_accumulated_x10000 >> BATTERY_VOLTAGE_FILTER_COEFFICIENT;
-  ui32_battery_voltage_accumulated_x10000 += (uint32_t) motor_controller_data.ui16_adc_battery_voltage * ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000;
-  ui16_battery_voltage_filtered_x10 = ((uint32_t) (ui32_battery_voltage_accumulated_x10000 >> BATTERY_VOLTAGE_FILTER_COEFFICIENT)) / 1000;
+  ui16_battery_voltage_filtered_x10 = filter_update (&battery_voltage_filter,
+      (uint32_t) motor_controller_data.ui16_adc_battery_voltage * ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000) / 1000;
 
   // low pass filter batery current
-  ui16_battery_current_accumulated_x5 -= ui16_battery_current_accumulated_x5 >> BATTERY_CURRENT_FILTER_COEFFICIENT;
-  ui16_battery_current_accumulated_x5 += (uint16_t) motor_controller_data.ui8_battery_current_x5;
-  ui16_battery_current_filtered_x5 = ui16_battery_current_accumulated_x5 >> BATTERY_CURRENT_FILTER_COEFFICIENT;
+  ui16_battery_current_filtered_x5 = filter_update (&battery_current_filter, (uint32_t) motor_controller_data.ui8_battery_current_x5);
 
   // battery power
   ui16_battery_power_filtered_x50 = ui16_battery_current_filtered_x5 * ui16_battery_voltage_filtered_x10;
@@ -2149,9 +1367,7 @@ void low_pass_filter_pedal_torque (void)
   ui32_torque_x10 = (ui32_torque_sensor_force_x1000 * motor_controller_data.ui8_pedal_cadence) / 955;
 
   // low pass filter
-  ui32_torque_accumulated -= ui32_torque_accumulated >> TORQUE_FILTER_COEFFICIENT;
-  ui32_torque_accumulated += ui32_torque_x10;
-  ui32_torque_filtered_x10 = ((uint32_t) (ui32_torque_accumulated >> TORQUE_FILTER_COEFFICIENT));
+  ui32_torque_filtered_x10 = filter_update (&pedal_torque_filter, ui32_torque_x10);
 
   // loose resolution under 10W
   if (ui32_torque_filtered_x10 < 1000)
@@ -2169,56 +1385,13 @@ void low_pass_filter_pedal_torque (void)
 
 void calc_wh (void)
 {
-  static uint8_t ui8_100ms_timmer_counter;
-  static uint8_t ui8_1s_timmer_counter;
-  uint32_t ui32_temp = 0;
-
-  // calc wh every 100ms
-  if (ui8_100ms_timmer_counter++ >= 10)
-  {
-    ui8_100ms_timmer_counter = 0;
-
-    if (ui16_battery_power_filtered_x50 > 0)
-    {
-      ui32_wh_sum_x5 += ui16_battery_power_filtered_x50 / 10;
-      ui32_wh_sum_counter++;
-    }
-
-    // calc at 1s rate
-    if (ui8_1s_timmer_counter++ >= 10)
-    {
-      ui8_1s_timmer_counter = 0;
-
-      // avoid  zero divisison
-      if (ui32_wh_sum_counter != 0)
-      {
-        ui32_temp = ui32_wh_sum_counter / 36;
-        ui32_temp = (ui32_temp * (ui32_wh_sum_x5 / ui32_wh_sum_counter)) / 500;
-      }
-
-      ui32_wh_x10 = configuration_variables.ui32_wh_x10_offset + ui32_temp;
-    }
-  }
+  // the energy is integrated at every received package, see battery_energy_update ()
+  ui32_wh_x10 = configuration_variables.ui32_wh_x10_offset + battery_energy_get_wh_x10 ();
 }
 
-void calc_odometer (void)
+uint32_t lcd_get_wh_x10 (void)
 {
-  uint32_t uint32_temp;
-  static uint8_t ui8_1s_timmer_counter;
-
-  // calc at 1s rate
-  if (ui8_1s_timmer_counter++ >= 100)
-  {
-    ui8_1s_timmer_counter = 0;
-
-    uint32_temp = motor_controller_data.ui32_wheel_speed_sensor_tick_counter * ((uint32_t) configuration_variables.ui16_wheel_perimeter);
-    // avoid division by 0
-    if (uint32_temp > 100000) { uint32_temp /= 100000;}  // milimmeters to 0.1kms
-    else { uint32_temp = 0; }
-
-    // now store the value on the global variable
-    configuration_variables.ui16_odometer_distance_x10 = (uint16_t) uint32_temp;
-  }
+  return ui32_wh_x10;
 }
 
 static void automatic_power_off_management (void)
@@ -2257,6 +1430,39 @@ static void automatic_power_off_management (void)
   }
 }
 
+void lcd_configuration_variables_changed (void)
+{
+  ui8_derived_values_valid = 0;
+}
+
+static void calc_derived_values (void)
+{
+  // OCV curve, voltage sag and capacity used by the state of charge estimator
+  battery_soc_configure (configuration_variables.ui8_battery_cells_number,
+      configuration_variables.ui16_battery_pack_resistance_x1000,
+      configuration_variables.ui32_wh_x10_100_percent);
+
+  // x10 volts to motor controller ADC units: (volts_x10 * 1000) / ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000
+  derived_values.ui16_adc_battery_voltage_reset_wh_counter = (uint16_t) (((uint32_t) configuration_variables.ui16_battery_voltage_reset_wh_counter_x10 * 1000) /
+      ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000);
+
+  // km/h / 1.6 == km/h * 5 / 8
+  derived_values.ui8_speed_factor_x8 = configuration_variables.ui8_units_type ? 5 : 8;
+
+  // filters
+  filter_set_coefficient (&battery_voltage_filter, configuration_variables.ui8_battery_voltage_filter_coefficient);
+  filter_set_coefficient (&battery_current_filter, configuration_variables.ui8_battery_current_filter_coefficient);
+  filter_set_coefficient (&pedal_torque_filter, configuration_variables.ui8_pedal_torque_filter_coefficient);
+  filter_set_fast_response_threshold (&battery_voltage_filter,
+      (configuration_variables.ui8_filter_fast_response & 1) ? BATTERY_VOLTAGE_FILTER_FAST_RESPONSE_THRESHOLD : 0);
+  filter_set_fast_response_threshold (&battery_current_filter,
+      (configuration_variables.ui8_filter_fast_response & 2) ? BATTERY_CURRENT_FILTER_FAST_RESPONSE_THRESHOLD : 0);
+  filter_set_fast_response_threshold (&pedal_torque_filter,
+      (configuration_variables.ui8_filter_fast_response & 4) ? PEDAL_TORQUE_FILTER_FAST_RESPONSE_THRESHOLD : 0);
+
+  ui8_derived_values_valid = 1;
+}
+
 struct_configuration_variables* get_configuration_variables (void)
 {
   return &configuration_variables;
@@ -2273,6 +1479,11 @@ void lcd_init (void)
   lcd_set_frame_buffer ();
   lcd_update();
 
+  // coefficients and fast response are configured with the other derived values, see calc_derived_values ()
+  filter_init (&battery_voltage_filter, 0, 0);
+  filter_init (&battery_current_filter, 0, 0);
+  filter_init (&pedal_torque_filter, 0, 0);
+
   // init variables with the stored value on EEPROM
   eeprom_init_variables ();
 }
@@ -2356,6 +1567,9 @@ void update_menu_flashing_state (void)
 
 void advance_on_submenu (uint8_t* ui8_p_state, uint8_t ui8_state_max_number)
 {
+  // on digit by digit entry, ONOFF click goes to the next digit
+  if (p_menu_edit_digits_value) { return; }
+
   // advance on submenus on button_onoff_click_event
   if (get_button_onoff_click_event ())
   {
@@ -2365,39 +1579,322 @@ void advance_on_submenu (uint8_t* ui8_p_state, uint8_t ui8_state_max_number)
   }
 }
 
-void calc_battery_soc_watts_hour (void)
+static uint32_t menu_value_get (const struct_menu_item *p_item, uint8_t *p_value)
+{
+  if (p_item->ui8_bit_mask) { return (*p_value & p_item->ui8_bit_mask) ? 1 : 0; }
+
+  switch (p_item->ui8_size)
+  {
+    case 1:
+      return *p_value;
+
+    case 2:
+      return *((uint16_t *) p_value);
+
+    default:
+      return *((uint32_t *) p_value);
+  }
+}
+
+static void menu_value_set (const struct_menu_item *p_item, uint8_t *p_value, uint32_t ui32_value)
+{
+  if (p_item->ui8_bit_mask)
+  {
+    if (ui32_value) { *p_value |= p_item->ui8_bit_mask; }
+    else { *p_value &= ~p_item->ui8_bit_mask; }
+    return;
+  }
+
+  switch (p_item->ui8_size)
+  {
+    case 1:
+      *p_value = (uint8_t) ui32_value;
+    break;
+
+    case 2:
+      *((uint16_t *) p_value) = (uint16_t) ui32_value;
+    break;
+
+    default:
+      *((uint32_t *) p_value) = ui32_value;
+    break;
+  }
+}
+
+// returns 1 and consumes the event if it is a click or a repeat of the button
+static uint8_t menu_edit_button_event (const struct_menu_item *p_item, uint8_t ui8_button)
+{
+  if (button_event_is (ui8_button, BUTTON_EVENT_REPEAT) &&
+      !(p_item->ui8_flags & MENU_ITEM_NO_REPEAT))
+  {
+    if (ui8_menu_edit_repeats < 255) { ui8_menu_edit_repeats++; }
+  }
+  else if (!button_event_is (ui8_button, BUTTON_EVENT_CLICK))
+  {
+    return 0;
+  }
+
+  button_event_consume ();
+  return 1;
+}
+
+static uint8_t menu_item_states (const struct_menu_item *p_item)
+{
+  return (p_item->ui8_flags & MENU_ITEM_ASSIST_LEVELS) ? configuration_variables.ui8_number_of_assist_levels : 1;
+}
+
+// shows and edits the item of ui8_lcd_menu_config_submenu_state of the current submenu
+void lcd_execute_menu_config_submenu (void)
 {
+  const struct_menu_item *p_first = menu_items;
+  const struct_menu_item *p_item;
+  uint8_t ui8_submenu = ui8_lcd_menu_config_submenu_number;
+  uint8_t ui8_states = 0;
+  uint8_t ui8_state;
+
+  while (ui8_submenu)
+  {
+    if ((p_first++)->ui8_size == 0) { ui8_submenu--; }
+  }
+
+  for (p_item = p_first; p_item->ui8_size; p_item++) { ui8_states += menu_item_states (p_item); }
+
+  advance_on_submenu (&ui8_lcd_menu_config_submenu_state, ui8_states);
+  if (ui8_lcd_menu_config_submenu_state >= ui8_states) { ui8_lcd_menu_config_submenu_state = 0; }
+
+  ui8_state = ui8_lcd_menu_config_submenu_state;
+  for (p_item = p_first; ui8_state >= menu_item_states (p_item); p_item++) { ui8_state -= menu_item_states (p_item); }
+
+  menu_execute_item (p_item, ui8_state);
+
+  if (p_item->ui8_field != WHEEL_SPEED_FIELD)
+  {
+    lcd_print (ui8_lcd_menu_config_submenu_state, WHEEL_SPEED_FIELD, 1);
+  }
+}
+
+// Edits the value of a menu item and shows it, flashing, on its field. ui8_index is the assist level on
+// MENU_ITEM_ASSIST_LEVELS items.
+//
+// UP and DOWN click changes the value by one step, holding them repeats faster and faster (see button.c) and after
+// MENU_EDIT_ACCELERATION_REPEATS repeats each one is 10 steps, after twice as many 100 steps, if the range of the
+// value has at least 10 of the bigger steps. The value goes to a multiple of the step, so it changes in round numbers.
+//
+// Values with at least MENU_EDIT_DIGITS_MIN_STEPS steps can be entered digit by digit: ONOFF double click starts
+// on the first digit, UP and DOWN change only that digit and ONOFF click goes to the next one, up to the digit of
+// the step. After the last digit, or on another ONOFF double click, the value is limited to min and max and set.
+// Only the digits already entered are shown, so the current one is the last digit on the field.
+static void menu_execute_item (const struct_menu_item *p_item, uint8_t ui8_index)
+{
+  uint8_t *p_value = ((uint8_t *) p_item->p_value) + (ui8_index * p_item->ui8_size);
+  uint32_t ui32_value = menu_value_get (p_item, p_value);
+  uint32_t ui32_step = p_item->ui16_step;
+  uint32_t ui32_range = p_item->ui32_max - p_item->ui16_min;
   uint32_t ui32_temp;
+  uint8_t ui8_digit;
+
+  // digit by digit entry of another value is dropped
+  if (p_menu_edit_digits_value != p_value) { p_menu_edit_digits_value = 0; }
 
-  ui32_temp = ui32_wh_x10 * 100;
-  if (configuration_variables.ui32_wh_x10_100_percent > 0)
+  // acceleration is only while the same button is held
+  if (button_event_is (BUTTON_UP, BUTTON_EVENT_PRESS) ||
+      button_event_is (BUTTON_DOWN, BUTTON_EVENT_PRESS))
   {
-    ui32_temp /= configuration_variables.ui32_wh_x10_100_percent;
+    ui8_menu_edit_repeats = 0;
+  }
+
+  if (p_item->ui8_flags & MENU_ITEM_READ_ONLY)
+  {
+    // only shown
+  }
+  else if (p_menu_edit_digits_value)
+  {
+    ui8_digit = (ui32_menu_edit_digits_value / ui32_menu_edit_digit_weight) % 10;
+
+    if (menu_edit_button_event (p_item, BUTTON_UP))
+    {
+      if (ui8_digit < 9) { ui32_menu_edit_digits_value += ui32_menu_edit_digit_weight; }
+      else { ui32_menu_edit_digits_value -= 9 * ui32_menu_edit_digit_weight; }
+    }
+
+    if (menu_edit_button_event (p_item, BUTTON_DOWN))
+    {
+      if (ui8_digit > 0) { ui32_menu_edit_digits_value -= ui32_menu_edit_digit_weight; }
+      else { ui32_menu_edit_digits_value += 9 * ui32_menu_edit_digit_weight; }
+    }
+
+    if (get_button_onoff_click_event ())
+    {
+      clear_button_onoff_click_event ();
+
+      if ((ui32_menu_edit_digit_weight / 10) >= ui32_step) { ui32_menu_edit_digit_weight /= 10; }
+      else { ui32_menu_edit_digit_weight = 0; }
+    }
+
+    if (button_event_is (BUTTON_ONOFF, BUTTON_EVENT_DOUBLE_CLICK))
+    {
+      button_event_consume ();
+      ui32_menu_edit_digit_weight = 0;
+    }
+
+    // last digit entered
+    if (ui32_menu_edit_digit_weight == 0)
+    {
+      p_menu_edit_digits_value = 0;
+
+      ui32_value = ui32_menu_edit_digits_value;
+      if (ui32_value < p_item->ui16_min) { ui32_value = p_item->ui16_min; }
+      if (ui32_value > p_item->ui32_max) { ui32_value = p_item->ui32_max; }
+      menu_value_set (p_item, p_value, ui32_value);
+    }
   }
   else
   {
-    ui32_temp = 0;
+    if (ui8_menu_edit_repeats >= MENU_EDIT_ACCELERATION_REPEATS &&
+        ui32_range >= (ui32_step * 100))
+    {
+      ui32_step *= 10;
+
+      if (ui8_menu_edit_repeats >= (2 * MENU_EDIT_ACCELERATION_REPEATS) &&
+          ui32_range >= (ui32_step * 100))
+      {
+        ui32_step *= 10;
+      }
+    }
+
+    if (menu_edit_button_event (p_item, BUTTON_UP))
+    {
+      ui32_temp = ui32_step - (ui32_value % ui32_step);
+      if (ui32_value + ui32_temp <= p_item->ui32_max) { ui32_value += ui32_temp; }
+      else { ui32_value = p_item->ui32_max; }
+
+      menu_value_set (p_item, p_value, ui32_value);
+    }
+
+    if (menu_edit_button_event (p_item, BUTTON_DOWN))
+    {
+      ui32_temp = ui32_value % ui32_step;
+      if (ui32_temp == 0) { ui32_temp = ui32_step; }
+      if (ui32_value >= p_item->ui16_min + ui32_temp) { ui32_value -= ui32_temp; }
+      else { ui32_value = p_item->ui16_min; }
+
+      menu_value_set (p_item, p_value, ui32_value);
+    }
+
+    // start digit by digit entry on the first digit of max value
+    if (p_item->ui8_scale == 1 &&
+        (ui32_range / ui32_step) >= MENU_EDIT_DIGITS_MIN_STEPS &&
+        button_event_is (BUTTON_ONOFF, BUTTON_EVENT_DOUBLE_CLICK))
+    {
+      button_event_consume ();
+
+      p_menu_edit_digits_value = p_value;
+      ui32_menu_edit_digits_value = ui32_value;
+      ui32_menu_edit_digit_weight = 1;
+      while (ui32_menu_edit_digit_weight <= (p_item->ui32_max / 10)) { ui32_menu_edit_digit_weight *= 10; }
+    }
+  }
+
+  if (p_item->p_function)
+  {
+    p_item->p_function ();
+    ui32_value = menu_value_get (p_item, p_value);
   }
 
-  // 100% - current SOC or just current SOC
-  if (configuration_variables.ui8_show_numeric_battery_soc & 2)
+  if (p_item->ui8_flags & MENU_ITEM_KMH) { lcd_enable_kmh_symbol (1); }
+
+  if (ui8_lcd_menu_flash_state ||
+      (p_item->ui8_flags & MENU_ITEM_READ_ONLY))
+  {
+    if (p_item->ui8_flags & MENU_ITEM_UNITS)
+    {
+      if (ui32_value) { lcd_enable_mph_symbol (1); }
+      else { lcd_enable_kmh_symbol (1); }
+    }
+    else if (p_menu_edit_digits_value)
+    {
+      // the last digit of a value shown with decimal digit is the decimal digit
+      lcd_print (ui32_menu_edit_digits_value / ui32_menu_edit_digit_weight, p_item->ui8_field,
+          (p_item->ui8_options == 0 && ui32_menu_edit_digit_weight == 1) ? 0 : 1);
+    }
+    else
+    {
+      lcd_print (ui32_value * p_item->ui8_scale, p_item->ui8_field, p_item->ui8_options);
+    }
+  }
+}
+
+// set current Wh value
+static void menu_wh_x10_offset (void)
+{
+  // on the very first time, use current value of ui32_wh_x10
+  if (ui8_config_wh_x10_offset)
+  {
+    ui8_config_wh_x10_offset = 0;
+    configuration_variables.ui32_wh_x10_offset = ui32_wh_x10;
+  }
+
+  // keep reseting this values
+  battery_energy_reset ();
+  ui32_wh_x10 = 0;
+}
+
+static void menu_reset_to_defaults (void)
+{
+  if (ui8_reset_to_defaults_counter > 9)
+  {
+    eeprom_erase_key_value ();
+    // disables the power of LCD
+    GPIO_WriteLow(LCD3_ONOFF_POWER__PORT, LCD3_ONOFF_POWER__PIN);
+  }
+}
+
+// reset trip distance and total trip distance
+static void menu_reset_trip (void)
+{
+  if (ui8_reset_to_defaults_counter > 9)
   {
-    if (ui32_temp > 100)
-      ui32_temp = 100;
+    configuration_variables.ui32_odometer_x10 = 0;
+    trip_reset ();
+    ui8_reset_to_defaults_counter = 0;
+  }
+}
+
+// time of the last EEPROM save in milliseconds, TIM3 ticks are 1.024 ms
+static void menu_eeprom_write_time (void)
+{
+  ui16_menu_eeprom_write_time_ms = (((uint32_t) eeprom_get_write_time ()) * 1024) / 1000;
+}
 
-    ui16_battery_soc_watts_hour = 100 - ui32_temp;
+// button events lost because the events FIFO was full, since power on
+static void menu_button_events_lost (void)
+{
+  ui8_menu_button_events_lost = button_get_events_lost ();
+}
+
+void calc_battery_soc (void)
+{
+  uint16_t ui16_temp;
+
+  // remaining state of charge
+  ui16_temp = battery_soc_get_x10 () / 10;
+
+  // remaining SOC or used SOC (100% - remaining SOC)
+  if (configuration_variables.ui8_show_numeric_battery_soc & 2)
+  {
+    ui16_battery_soc = ui16_temp;
   }
   else
   {
-    ui16_battery_soc_watts_hour = ui32_temp;
+    ui16_battery_soc = 100 - ui16_temp;
   }
 }
 
 void lcd_power_off (void)
 {
   configuration_variables.ui32_wh_x10_offset = ui32_wh_x10;
-  configuration_variables.ui32_odometer_x10 += ((uint32_t) configuration_variables.ui16_odometer_distance_x10);
   eeprom_write_variables ();
+  eeprom_write_flush ();
 
   // clear LCD so it is clear to user what is happening
   lcd_clear ();
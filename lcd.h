@@ -60,13 +60,11 @@ typedef struct _configuration_variables
   uint8_t ui8_motor_voltage_type;
   uint8_t ui8_motor_assistance_startup_without_pedal_rotation;
   uint8_t ui8_pas_max_cadence;
-  uint8_t ui8_cruise_control;
   uint8_t ui8_assist_level_power [9];
   uint8_t ui8_startup_motor_power_boost_state;
   uint8_t ui8_startup_motor_power_boost_time;
   uint8_t ui8_startup_motor_power_boost_fade_time;
   uint8_t ui8_startup_motor_power_boost [9];
-  uint16_t ui16_adc_motor_temperature_10b;
   uint8_t ui8_throttle_adc_measures_motor_temperature;
   uint8_t ui8_motor_temperature_min_value_to_limit;
   uint8_t ui8_motor_temperature_max_value_to_limit;
@@ -81,6 +79,20 @@ typedef struct _configuration_variables
   uint8_t ui8_offroad_power_limit_div25;
   uint16_t ui16_odometer_distance_x10;
   uint32_t ui32_odometer_x10;
+  uint8_t ui8_battery_voltage_filter_coefficient;
+  uint8_t ui8_battery_current_filter_coefficient;
+  uint8_t ui8_pedal_torque_filter_coefficient;
+  uint8_t ui8_filter_fast_response;
+  uint32_t ui32_trip_moving_time_seconds;
+  uint32_t ui32_trip_total_time_seconds;
+  uint16_t ui16_trip_max_speed_x10;
+  uint32_t ui32_trip_energy_ws;
+  uint8_t ui8_profile;
+
+  // the variables above are stored on EEPROM as they are in memory (see eeprom.h), new ones must be added at the end,
+  // the variables below are not stored
+  uint8_t ui8_cruise_control;
+  uint16_t ui16_adc_motor_temperature_10b;
 } struct_configuration_variables;
 
 // LCD RAM has 32*8 bits
@@ -130,5 +142,8 @@ void clock_lcd (void);
 struct_configuration_variables* get_configuration_variables (void);
 struct_motor_controller_data* lcd_get_motor_controller_data (void);
 void automatic_power_off_counter_reset (void);
+void lcd_configuration_variables_changed (void);
+void lcd_set_backlight_intensity (uint8_t ui8_intensity);
+uint32_t lcd_get_wh_x10 (void);
 
 #endif /* _LCD_H_ */
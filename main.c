@@ -18,6 +18,7 @@
 #include "button.h"
 #include "ht162.h"
 #include "config.h"
+#include "brownout.h"
 
 // With SDCC, interrupt service routine function prototypes must be placed in the file that contains main ()
 // in order for an vector for the interrupt to be placed in the the interrupt vector space.  It's acceptable
@@ -40,11 +41,16 @@
 //// Functions prototypes
 // UART2 Receive interrupt
 void UART2_IRQHandler(void) __interrupt(UART2_IRQHANDLER);
+// UP and DOWN buttons edges
+void EXTI_PORTB_IRQHandler(void) __interrupt(EXTI_PORTB_IRQHANDLER);
+// TIM3 compare, to wake up from wfi every TIM3 tick
+void TIM3_CAP_COM_IRQHandler(void) __interrupt(TIM3_CAP_COM_IRQHANDLER);
 
 int main (void)
 {
   uint16_t ui16_tim3_counter;
   uint16_t ui16_10ms_loop_counter;
+  uint16_t ui16_1ms_loop_counter;
 
   //set clock at the max 16MHz
   CLK_HSIPrescalerConfig (CLK_PRESCALER_HSIDIV1);
@@ -55,6 +61,8 @@ int main (void)
   adc_init ();
   eeprom_init ();
   lcd_init (); // must be after eeprom_init ();
+  brownout_init ();
+  button_init ();
   enableInterrupts ();
 
   // block until users releases the buttons
@@ -69,6 +77,17 @@ int main (void)
     // because of continue; at the end of each if code block that will stop the while (1) loop there,
     // the first if block code will have the higher priority over any others
     ui16_tim3_counter = TIM3_GetCounter ();
+    if (ui16_tim3_counter != ui16_1ms_loop_counter) // every 1ms
+    {
+      ui16_1ms_loop_counter = ui16_tim3_counter;
+
+      clock_brownout ();
+      clock_eeprom ();
+      clock_button_inputs ();
+
+      continue;
+    }
+
     if ((ui16_tim3_counter - ui16_10ms_loop_counter) > 10) // every 10ms
     {
       ui16_10ms_loop_counter = ui16_tim3_counter;
@@ -96,6 +115,10 @@ int main (void)
       continue;
     }
 #endif
+
+    // nothing to do until the next TIM3 tick: wait on low power, the TIM3 compare interrupt wakes up the CPU on
+    // every tick
+    wfi ();
   }
 
   return 0;
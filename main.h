@@ -10,11 +10,13 @@
 #define _MAIN_H_
 
 #define EXTI_PORTA_IRQHANDLER 3
+#define EXTI_PORTB_IRQHANDLER 4
 #define EXTI_PORTC_IRQHANDLER 5
 #define EXTI_PORTD_IRQHANDLER 6
 #define EXTI_PORTE_IRQHANDLER 7
 #define TIM1_CAP_COM_IRQHANDLER   12
 #define TIM2_UPD_OVF_TRG_BRK_IRQHANDLER 13
+#define TIM3_CAP_COM_IRQHANDLER 16
 #define UART2_IRQHANDLER 21
 #define ADC1_IRQHANDLER 22
 
@@ -22,21 +24,22 @@
 // EEPROM memory variables default values
 #define DEFAULT_VALUE_ASSIST_LEVEL                                  3
 #define DEFAULT_VALUE_NUMBER_OF_ASSIST_LEVELS                       9
-#define DEFAULT_VALUE_WHEEL_PERIMETER_0                             2 // 26'' wheel: 2050mm perimeter (2 + (8 << 8))
-#define DEFAULT_VALUE_WHEEL_PERIMETER_1                             8
+#define DEFAULT_VALUE_WHEEL_PERIMETER                               2050 // 26'' wheel: 2050mm perimeter
 #define DEFAULT_VALUE_WHEEL_MAX_SPEED                               50
 #define DEFAULT_VALUE_UNITS_TYPE                                    0 // 0 = km/h
 #define DEFAULT_VALUE_WH_OFFSET                                     0
 #define DEFAULT_VALUE_HW_X10_100_PERCENT                            0
-#define DEAFULT_VALUE_SHOW_NUMERIC_BATTERY_SOC                      0
+#define DEFAULT_VALUE_SHOW_NUMERIC_BATTERY_SOC                      0
 #define DEFAULT_VALUE_ODOMETER_FIELD_STATE                          0
 #define DEFAULT_VALUE_BATTERY_MAX_CURRENT                           16 // 16 amps
 #define DEFAULT_VALUE_TARGET_MAX_BATTERY_POWER                      20 // 20 * 25 = 500
 #define DEFAULT_VALUE_BATTERY_CELLS_NUMBER                          13 // 13 --> 48V
-#define DEFAULT_VALUE_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_0             134 // 48v battery, LVC = 39.0 (3.0 * 13): (134 + (1 << 8))
-#define DEFAULT_VALUE_BATTERY_LOW_VOLTAGE_CUT_OFF_X10_1             1
+#define DEFAULT_VALUE_BATTERY_LOW_VOLTAGE_CUT_OFF_X10               390 // 48v battery, LVC = 39.0 (3.0 * 13)
 #define DEFAULT_VALUE_PAS_MAX_CADENCE                               110 // 110 RPM
-#define DEFAULT_VALUE_CONFIG_0                                      0 // ui8_motor_voltage_type = 0; ui8_motor_assistance_startup_config = 0
+#define DEFAULT_VALUE_MOTOR_VOLTAGE_TYPE                            0
+#define DEFAULT_VALUE_MOTOR_ASSISTANCE_WITHOUT_PEDAL_ROTATION       0
+#define DEFAULT_VALUE_THROTTLE_ADC_MEASURES_MOTOR_TEMPERATURE       0
+#define DEFAULT_VALUE_TEMPERATURE_FIELD_CONFIG                      0
 #define DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_1                         16 // 400W
 #define DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_2                         24
 #define DEFAULT_VALUE_ASSIST_LEVEL_FACTOR_3                         32
@@ -60,19 +63,30 @@
 #define DEFAULT_VALUE_STARTUP_MOTOR_POWER_BOOST_FADE_TIME           25 // 2.5 seconds
 #define DEFAULT_VALUE_MOTOR_TEMPERATURE_MIN_VALUE_LIMIT             75 // 75 degrees celsius
 #define DEFAULT_VALUE_MOTOR_TEMPERATURE_MAX_VALUE_LIMIT             85
-#define DEFAULT_VALUE_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_0        30 // 48v battery, 54.2 volts fully charged = 54.2: (30 + (2 << 8))
-#define DEFAULT_VALUE_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10_1        2
+#define DEFAULT_VALUE_BATTERY_VOLTAGE_RESET_WH_COUNTER_X10          542 // 48v battery, 54.2 volts fully charged
 #define DEFAULT_VALUE_LCD_POWER_OFF_TIME                            15 // 15 minutes, each unit 1 minute
 #define DEFAULT_VALUE_LCD_BACKLIGHT_ON_BRIGHTNESS                   16 // 16 = 80%
 #define DEFAULT_VALUE_LCD_BACKLIGHT_OFF_BRIGHTNESS                  1 // 1 = 5%
-#define DEFAULT_VALUE_BATTERY_PACK_RESISTANCE_0                     130 // 48v battery, 13S5P measured 130 milli ohms
-#define DEFAULT_VALUE_BATTERY_PACK_RESISTANCE_1                     0
+#define DEFAULT_VALUE_BATTERY_PACK_RESISTANCE                       130 // 48v battery, 13S5P measured 130 milli ohms
 #define DEFAULT_VALUE_OFFROAD_FUNC_ENABLED                          0
 #define DEFAULT_VALUE_OFFROAD_MODE_ENABLED_ON_STARTUP               0
 #define DEFAULT_VALUE_OFFROAD_SPEED_LIMIT                           25
 #define DEFAULT_VALUE_OFFROAD_POWER_LIMIT_ENABLED                   0
 #define DEFAULT_VALUE_OFFROAD_POWER_LIMIT_DIV25                     10 //10 * 25 = 250W
 #define DEFAULT_VALUE_ODOMETER_X10                                  0
+#define DEFAULT_VALUE_BATTERY_VOLTAGE_FILTER_COEFFICIENT            6
+#define DEFAULT_VALUE_BATTERY_CURRENT_FILTER_COEFFICIENT            5
+#define DEFAULT_VALUE_PEDAL_TORQUE_FILTER_COEFFICIENT               5
+#define DEFAULT_VALUE_FILTER_FAST_RESPONSE                          0 // bit 0: battery voltage; bit 1: battery current; bit 2: pedal torque
+#define DEFAULT_VALUE_TRIP                                          0
+#define DEFAULT_VALUE_PROFILE                                       0
+
+// limits of the values that are not limited by their type or the motor controller
+#define PAS_MAX_CADENCE_MIN                                         40 // RPM
+#define PAS_MAX_CADENCE_MAX                                         160
+#define LCD_POWER_OFF_TIME_MAX                                      240 // 4 hours, 0 disables the auto power off
+#define BATTERY_VOLTAGE_X10_MIN                                     161 // 16.1 V, of the LVC and the Wh counter reset
+#define BATTERY_VOLTAGE_X10_MAX                                     630 // 63.0 V
 
 // *************************************************************************** //
 
@@ -89,7 +103,7 @@
 // 0.344 per ADC_8bits step: 17.9V --> ADC_8bits = 52; 40V --> ADC_8bits = 116; this signal atenuated by the opamp 358
 #define ADC10BITS_BATTERY_VOLTAGE_PER_ADC_STEP_X512 44
 #define ADC10BITS_BATTERY_VOLTAGE_PER_ADC_STEP_X256 (ADC10BITS_BATTERY_VOLTAGE_PER_ADC_STEP_X512 >> 1)
-#define ADC8BITS_BATTERY_VOLTAGE_PER_ADC_STEP 0.344
+#define ADC8BITS_BATTERY_VOLTAGE_PER_ADC_STEP_X1000 344
 
 // ADC Battery current
 // 1A per 5 steps of ADC_10bits
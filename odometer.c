@@ -0,0 +1,189 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "stm8s_tim3.h"
+#include "main.h"
+#include "lcd.h"
+#include "odometer.h"
+
+// The motor controller wheel speed sensor tick counter has 24 bits and starts from 0 at motor controller power up.
+// Distance is accumulated from the difference of the tick counter between updates: ticks * wheel perimeter (mm)
+// are added to a remainder in millimeters, and every 100000 mm (0.1 km) of the remainder increments the trip and
+// total odometer.
+//
+// The 3 bytes of the tick counter are received on 3 different packages, so a value can be torn: when the low byte
+// wraps between the packages, the value is 256 ticks ahead and the next one goes back. Each difference is checked
+// against the ticks that are possible on the time since the last accepted value, at ODOMETER_MAX_TICKS_PER_SECOND:
+// other values are not added, the next value is compared again with the last accepted one, and only two
+// consistent values are taken as a motor controller reset (counter started again from 0) or as a new reference.
+// Each update adds at most the possible ticks in 64 seconds * wheel perimeter, so nothing will overflow.
+#define ODOMETER_TICK_COUNTER_MASK      0xffffff
+#define ODOMETER_MM_PER_X10_KM          100000
+#define ODOMETER_MAX_TICKS_PER_SECOND   40    // 100 km/h with the smallest wheel perimeter of 750 mm
+#define ODOMETER_MAX_TICKS_MARGIN       2     // the ticks and the time are not sampled at the same moment
+
+static uint32_t ui32_odometer_last_tick_counter;
+static uint16_t ui16_odometer_last_time;
+static uint32_t ui32_odometer_resync_tick_counter;
+static uint16_t ui16_odometer_resync_time;
+static uint8_t ui8_odometer_resync;
+static uint32_t ui32_odometer_distance_mm;
+static uint8_t ui8_odometer_first_update = 1;
+
+// Wheel speed estimator
+//
+// The distance of the new ticks is divided by the time since the previous new ticks (not since the previous package),
+// which is a period measurement and so has good resolution also at low speeds:
+// speed_x10 (km/h) = mm * 36 / ms = mm * 36 / (TIM3 ticks * 1.024) = mm * 1125 / (TIM3 ticks * 32).
+// Without new ticks, the estimated speed is limited to the speed of one more tick right now, so it goes down smoothly
+// and reaches 0 after SPEED_MAX_TIME.
+// The estimated speed is blended with the motor controller speed and is 0 when motor controller speed is 0.
+#define SPEED_MAX_TIME              2930 // 3 seconds
+#define SPEED_MAX_DISTANCE_MM       3000000 // so mm * 1125 will not overflow
+
+static uint16_t ui16_speed_last_time;
+static uint16_t ui16_speed_elapsed_time;
+static uint32_t ui32_speed_new_distance_mm;
+static uint16_t ui16_speed_estimated_x10;
+static uint16_t ui16_speed_x10;
+
+// ticks that are possible on the elapsed TIM3 ticks (1.024 ms)
+static uint32_t odometer_max_ticks (uint16_t ui16_elapsed_time)
+{
+  return ((((uint32_t) ui16_elapsed_time) * ODOMETER_MAX_TICKS_PER_SECOND) / 977) + ODOMETER_MAX_TICKS_MARGIN;
+}
+
+void odometer_update (uint32_t ui32_wheel_speed_sensor_tick_counter)
+{
+  uint16_t ui16_time;
+  uint32_t ui32_max_ticks;
+  uint32_t ui32_delta_ticks;
+  uint16_t ui16_distance_x10;
+  struct_configuration_variables *p_configuration_variables;
+
+  ui32_wheel_speed_sensor_tick_counter &= ODOMETER_TICK_COUNTER_MASK;
+  ui16_time = TIM3_GetCounter ();
+
+  // start counting from the first value received
+  if (ui8_odometer_first_update)
+  {
+    ui8_odometer_first_update = 0;
+    ui32_odometer_last_tick_counter = ui32_wheel_speed_sensor_tick_counter;
+    ui16_odometer_last_time = ui16_time;
+    return;
+  }
+
+  // 24 bits counter, the mask takes care of the counter wrap around
+  ui32_delta_ticks = (ui32_wheel_speed_sensor_tick_counter - ui32_odometer_last_tick_counter) & ODOMETER_TICK_COUNTER_MASK;
+  ui32_max_ticks = odometer_max_ticks (ui16_time - ui16_odometer_last_time);
+
+  if (ui32_delta_ticks > ui32_max_ticks)
+  {
+    // torn value, communications error or motor controller reset: nothing is added until other value confirms it
+    if ((ui8_odometer_resync == 0) ||
+        (((ui32_wheel_speed_sensor_tick_counter - ui32_odometer_resync_tick_counter) & ODOMETER_TICK_COUNTER_MASK) >
+            odometer_max_ticks (ui16_time - ui16_odometer_resync_time)))
+    {
+      ui8_odometer_resync = 1;
+      ui32_odometer_resync_tick_counter = ui32_wheel_speed_sensor_tick_counter;
+      ui16_odometer_resync_time = ui16_time;
+      return;
+    }
+
+    // two consistent values: the motor controller was reset and the ticks since then are added, or else the counter
+    // is used as the new reference without adding the unknown distance
+    if (ui32_wheel_speed_sensor_tick_counter <= ui32_max_ticks) { ui32_delta_ticks = ui32_wheel_speed_sensor_tick_counter; }
+    else { ui32_delta_ticks = 0; }
+  }
+
+  ui32_odometer_last_tick_counter = ui32_wheel_speed_sensor_tick_counter;
+  ui16_odometer_last_time = ui16_time;
+  ui8_odometer_resync = 0;
+
+  if (ui32_delta_ticks == 0) { return; }
+
+  p_configuration_variables = get_configuration_variables ();
+
+  // for the wheel speed estimator
+  ui32_speed_new_distance_mm += ui32_delta_ticks * ((uint32_t) p_configuration_variables->ui16_wheel_perimeter);
+
+  ui32_odometer_distance_mm += ui32_delta_ticks * ((uint32_t) p_configuration_variables->ui16_wheel_perimeter);
+  if (ui32_odometer_distance_mm >= ODOMETER_MM_PER_X10_KM)
+  {
+    ui16_distance_x10 = (uint16_t) (ui32_odometer_distance_mm / ODOMETER_MM_PER_X10_KM);
+    ui32_odometer_distance_mm %= ODOMETER_MM_PER_X10_KM;
+
+    p_configuration_variables->ui16_odometer_distance_x10 += ui16_distance_x10;
+    p_configuration_variables->ui32_odometer_x10 += ui16_distance_x10;
+  }
+}
+
+void odometer_speed_update (uint16_t ui16_controller_wheel_speed_x10)
+{
+  uint16_t ui16_time;
+  uint32_t ui32_speed_x10;
+  uint16_t ui16_speed_limit_x10;
+  struct_configuration_variables *p_configuration_variables;
+
+  ui16_time = TIM3_GetCounter ();
+  ui16_speed_elapsed_time += ui16_time - ui16_speed_last_time;
+  ui16_speed_last_time = ui16_time;
+  if (ui16_speed_elapsed_time > SPEED_MAX_TIME) { ui16_speed_elapsed_time = SPEED_MAX_TIME; }
+
+  if (ui32_speed_new_distance_mm)
+  {
+    if ((ui32_speed_new_distance_mm <= SPEED_MAX_DISTANCE_MM) &&
+        (ui16_speed_elapsed_time < SPEED_MAX_TIME) &&
+        (ui16_speed_elapsed_time > 0))
+    {
+      ui32_speed_x10 = (ui32_speed_new_distance_mm * 1125) / (((uint32_t) ui16_speed_elapsed_time) * 32);
+      ui16_speed_estimated_x10 = (ui32_speed_x10 > 0xffff) ? 0xffff : (uint16_t) ui32_speed_x10;
+    }
+    else
+    {
+      // first ticks after stopped, there is no valid period yet
+      ui16_speed_estimated_x10 = 0;
+    }
+
+    ui32_speed_new_distance_mm = 0;
+    ui16_speed_elapsed_time = 0;
+  }
+  else if (ui16_speed_elapsed_time >= SPEED_MAX_TIME)
+  {
+    ui16_speed_estimated_x10 = 0;
+  }
+  else if (ui16_speed_elapsed_time > 0)
+  {
+    // the next tick did not happen yet, so the speed is at most one wheel perimeter over the elapsed time
+    p_configuration_variables = get_configuration_variables ();
+    ui32_speed_x10 = (((uint32_t) p_configuration_variables->ui16_wheel_perimeter) * 1125) / (((uint32_t) ui16_speed_elapsed_time) * 32);
+    ui16_speed_limit_x10 = (ui32_speed_x10 > 0xffff) ? 0xffff : (uint16_t) ui32_speed_x10;
+    if (ui16_speed_estimated_x10 > ui16_speed_limit_x10) { ui16_speed_estimated_x10 = ui16_speed_limit_x10; }
+  }
+
+  // blend with the motor controller speed
+  if (ui16_controller_wheel_speed_x10 == 0)
+  {
+    ui16_speed_x10 = 0;
+  }
+  else if (ui16_speed_estimated_x10 == 0)
+  {
+    ui16_speed_x10 = ui16_controller_wheel_speed_x10;
+  }
+  else
+  {
+    ui16_speed_x10 = (uint16_t) ((((uint32_t) ui16_speed_estimated_x10) * 3 + ((uint32_t) ui16_controller_wheel_speed_x10)) >> 2);
+  }
+}
+
+uint16_t odometer_get_speed_x10 (void)
+{
+  return ui16_speed_x10;
+}
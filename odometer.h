@@ -0,0 +1,18 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _ODOMETER_H_
+#define _ODOMETER_H_
+
+#include "main.h"
+
+void odometer_update (uint32_t ui32_wheel_speed_sensor_tick_counter);
+void odometer_speed_update (uint16_t ui16_controller_wheel_speed_x10);
+uint16_t odometer_get_speed_x10 (void);
+
+#endif /* _ODOMETER_H_ */
@@ -0,0 +1,124 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "main.h"
+#include "lcd.h"
+#include "battery.h"
+#include "range.h"
+
+// Efficiency and range
+//
+// The energy used on each of the last RANGE_WINDOW_KM kms is kept on a ring buffer together with its sum, so the
+// rolling efficiency (Wh/km) is updated with constant time and memory at each new km. Up to the first km, the trip
+// average efficiency is used. Remaining range is the remaining battery energy (100 % Wh * SOC) / efficiency.
+#define RANGE_WINDOW_KM   10
+
+// 6553.5 km, the maximum of the uint16_t value (the odometer field shows up to 9999.9)
+#define RANGE_MAX_REMAINING_KM_X10  0xffff
+
+static uint16_t ui16_range_wh_x10 [RANGE_WINDOW_KM];
+static uint16_t ui16_range_wh_x10_sum;
+static uint8_t ui8_range_index;
+static uint8_t ui8_range_count;
+
+static uint32_t ui32_range_last_odometer_x10;
+static uint32_t ui32_range_last_wh_x10;
+static uint8_t ui8_range_distance_x10;
+static uint8_t ui8_range_first_update = 1;
+
+void range_update (void)
+{
+  uint32_t ui32_wh_x10;
+  uint32_t ui32_odometer_x10;
+  struct_configuration_variables *p_configuration_variables;
+
+  p_configuration_variables = get_configuration_variables ();
+  ui32_odometer_x10 = p_configuration_variables->ui32_odometer_x10;
+  ui32_wh_x10 = battery_energy_get_wh_x10 ();
+
+  if (ui8_range_first_update)
+  {
+    ui8_range_first_update = 0;
+    ui32_range_last_odometer_x10 = ui32_odometer_x10;
+    ui32_range_last_wh_x10 = ui32_wh_x10;
+    return;
+  }
+
+  // odometer was reset: start again the current km
+  if (ui32_odometer_x10 < ui32_range_last_odometer_x10)
+  {
+    ui32_range_last_odometer_x10 = ui32_odometer_x10;
+    ui32_range_last_wh_x10 = ui32_wh_x10;
+    ui8_range_distance_x10 = 0;
+    return;
+  }
+
+  ui8_range_distance_x10 += (uint8_t) (ui32_odometer_x10 - ui32_range_last_odometer_x10);
+  ui32_range_last_odometer_x10 = ui32_odometer_x10;
+
+  // a new km
+  if (ui8_range_distance_x10 >= 10)
+  {
+    ui8_range_distance_x10 -= 10;
+
+    // energy counter was reset: skip this km
+    if (ui32_wh_x10 >= ui32_range_last_wh_x10)
+    {
+      ui16_range_wh_x10_sum -= ui16_range_wh_x10 [ui8_range_index];
+      ui16_range_wh_x10 [ui8_range_index] = (uint16_t) (ui32_wh_x10 - ui32_range_last_wh_x10);
+      ui16_range_wh_x10_sum += ui16_range_wh_x10 [ui8_range_index];
+
+      if (++ui8_range_index >= RANGE_WINDOW_KM) { ui8_range_index = 0; }
+      if (ui8_range_count < RANGE_WINDOW_KM) { ui8_range_count++; }
+    }
+
+    ui32_range_last_wh_x10 = ui32_wh_x10;
+  }
+}
+
+uint16_t range_get_trip_wh_km_x10 (void)
+{
+  struct_configuration_variables *p_configuration_variables;
+  p_configuration_variables = get_configuration_variables ();
+
+  if (p_configuration_variables->ui16_odometer_distance_x10 == 0) { return 0; }
+
+  // (W.s / 3600) Wh / (distance_x10 / 10) km * 10 = W.s / (36 * distance_x10)
+  return (uint16_t) (p_configuration_variables->ui32_trip_energy_ws /
+      (((uint32_t) p_configuration_variables->ui16_odometer_distance_x10) * 36));
+}
+
+uint16_t range_get_wh_km_x10 (void)
+{
+  if (ui8_range_count == 0) { return range_get_trip_wh_km_x10 (); }
+
+  return ui16_range_wh_x10_sum / ui8_range_count;
+}
+
+uint16_t range_get_remaining_km_x10 (void)
+{
+  uint16_t ui16_wh_km_x10;
+  uint32_t ui32_remaining_wh_x10;
+  uint32_t ui32_remaining_km_x10;
+  struct_configuration_variables *p_configuration_variables;
+
+  p_configuration_variables = get_configuration_variables ();
+  ui16_wh_km_x10 = range_get_wh_km_x10 ();
+
+  if (ui16_wh_km_x10 == 0) { return 0; }
+
+  ui32_remaining_wh_x10 = (p_configuration_variables->ui32_wh_x10_100_percent * battery_soc_get_x10 ()) / 1000;
+
+  // Wh_x10 / Wh_km_x10 = km, * 10 to km x10: a low Wh/km (like at the first kms of a trip downhill) gives values
+  // that do not fit on the uint16_t
+  ui32_remaining_km_x10 = (ui32_remaining_wh_x10 * 10) / ui16_wh_km_x10;
+  if (ui32_remaining_km_x10 > RANGE_MAX_REMAINING_KM_X10) { ui32_remaining_km_x10 = RANGE_MAX_REMAINING_KM_X10; }
+
+  return (uint16_t) ui32_remaining_km_x10;
+}
@@ -0,0 +1,19 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _RANGE_H_
+#define _RANGE_H_
+
+#include "main.h"
+
+void range_update (void);
+uint16_t range_get_wh_km_x10 (void);
+uint16_t range_get_trip_wh_km_x10 (void);
+uint16_t range_get_remaining_km_x10 (void);
+
+#endif /* _RANGE_H_ */
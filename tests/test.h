@@ -0,0 +1,29 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+
+// Host tests: the modules that are plain integer C are built with the host gcc, with stubs for the peripherals,
+// see tests/Makefile. Each failed check is printed and the test exits with the number of failed checks.
+static int test_failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { test_failures++; printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); } } while (0)
+
+#define CHECK_EQUAL(value, expected) \
+    do { long long test_value = (long long) (value), test_expected = (long long) (expected); \
+         if (test_value != test_expected) { test_failures++; \
+           printf ("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #value, test_value, test_expected); } } while (0)
+
+#define TEST_RESULT(name) \
+    (printf ("%s: %s\n", (name), test_failures ? "FAILED" : "ok"), test_failures)
+
+#endif /* _TEST_H_ */
@@ -0,0 +1,176 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "config.h"
+#include "battery.h"
+#include "test.h"
+
+// Energy integrator against synthetic ride profiles: each profile sends packages with the battery voltage and current
+// at some time interval, as the motor controller does, and the Wh of battery_energy_get_wh_x10 () must be the
+// exact value: the sum of voltage * current * elapsed time of all the packages, with 64 bits math.
+
+// 0.0863 V * 0.2 A * 1.024 ms: energy units of ADC step * current x5 * TIM3 tick, see battery.c
+#define JOULES_PER_ENERGY_UNIT    (((double) ADC_BATTERY_VOLTAGE_PER_ADC_STEP_X10000 / 10000.0) * 0.2 * 0.001024)
+#define MAX_DELTA_TIME            488     // elapsed time limit of battery.c, 0.5 s
+#define TICKS_PER_HOUR            3515625 // 3600 s / 1.024 ms
+
+// TIM3 counter stub, the profiles move the time
+static uint16_t ui16_tim3_counter;
+
+uint16_t TIM3_GetCounter (void)
+{
+  return ui16_tim3_counter;
+}
+
+static uint64_t ui64_expected_energy_units;
+
+static void profile_start (uint16_t ui16_adc_battery_voltage)
+{
+  // the first package after a reset has no previous time, the profile starts from a package without current
+  battery_update (ui16_adc_battery_voltage, 0);
+  battery_energy_reset ();
+  ui64_expected_energy_units = 0;
+}
+
+static void package (uint16_t ui16_adc_battery_voltage, uint8_t ui8_battery_current_x5, uint16_t ui16_delta_time)
+{
+  ui16_tim3_counter += ui16_delta_time;
+  battery_update (ui16_adc_battery_voltage, ui8_battery_current_x5);
+
+  if (ui16_delta_time > MAX_DELTA_TIME) { ui16_delta_time = MAX_DELTA_TIME; }
+  ui64_expected_energy_units += ((uint64_t) ui16_adc_battery_voltage) * ui8_battery_current_x5 * ui16_delta_time;
+}
+
+static void check_energy (const char *p_profile)
+{
+  uint32_t ui32_expected_wh_x10;
+  double f_wh_x10;
+
+  // exact: all the energy units, no truncation on each package
+  ui32_expected_wh_x10 = (uint32_t) (ui64_expected_energy_units / 20368627);
+  CHECK_EQUAL (battery_energy_get_wh_x10 (), ui32_expected_wh_x10);
+
+  // and the units conversion: the same energy in physical units, to 0.1 Wh
+  f_wh_x10 = ((double) ui64_expected_energy_units) * JOULES_PER_ENERGY_UNIT / 360.0;
+  CHECK ((f_wh_x10 - (double) battery_energy_get_wh_x10 ()) >= 0.0);
+  CHECK ((f_wh_x10 - (double) battery_energy_get_wh_x10 ()) < 1.0);
+
+  printf ("%s: %u.%u Wh\n", p_profile, (unsigned) (battery_energy_get_wh_x10 () / 10), (unsigned) (battery_energy_get_wh_x10 () % 10));
+}
+
+// 1 hour at 36 V and 10 A, package every 50 ms: 360 Wh
+static void test_constant_power (void)
+{
+  uint32_t ui32_time;
+
+  profile_start (417);
+  for (ui32_time = 0; ui32_time < TICKS_PER_HOUR; ui32_time += 49)
+  {
+    package (417, 50, 49);
+  }
+  check_energy ("constant power");
+
+  CHECK (battery_energy_get_wh_x10 () >= 3590);
+  CHECK (battery_energy_get_wh_x10 () <= 3610);
+}
+
+// city ride: stopped at traffic lights, accelerating at high current and cruising, with a communication loss
+// of 2 s that must count only 0.5 s of the last current
+static void test_stop_and_go (void)
+{
+  uint8_t ui8_cycle;
+  uint16_t ui16_package;
+  uint8_t ui8_current_x5;
+
+  profile_start (430);
+  for (ui8_cycle = 0; ui8_cycle < 40; ui8_cycle++)
+  {
+    // 30 s stopped
+    for (ui16_package = 0; ui16_package < 600; ui16_package++) { package (432, 0, 49); }
+
+    // 10 s accelerating, current up to 25 A with the voltage sag
+    for (ui16_package = 0; ui16_package < 200; ui16_package++)
+    {
+      ui8_current_x5 = (uint8_t) ((ui16_package < 125) ? ui16_package : 125);
+      package ((uint16_t) (432 - (ui8_current_x5 / 4)), ui8_current_x5, 49);
+    }
+
+    // 60 s cruising at 8 A
+    for (ui16_package = 0; ui16_package < 1200; ui16_package++) { package (422, 40, 49); }
+
+    if (ui8_cycle == 20) { package (422, 40, 1953); }
+  }
+  check_energy ("stop and go");
+}
+
+// 4 hours ride, voltage from full to almost empty 13S battery, random current and package interval,
+// the TIM3 counter wraps more than 200 times
+static void test_long_ride (void)
+{
+  uint32_t ui32_time = 0;
+  uint32_t ui32_random = 12345;
+  uint16_t ui16_adc_battery_voltage;
+  uint16_t ui16_delta_time;
+
+  profile_start (633);
+  while (ui32_time < (4 * TICKS_PER_HOUR))
+  {
+    ui32_random = (ui32_random * 1103515245) + 12345;
+    ui16_delta_time = (uint16_t) (40 + ((ui32_random >> 16) % 21));
+    ui32_time += ui16_delta_time;
+
+    ui16_adc_battery_voltage = (uint16_t) (633 - ((ui32_time / TICKS_PER_HOUR) * 35) - ((ui32_random >> 8) & 7));
+    package (ui16_adc_battery_voltage, (uint8_t) ((ui32_random >> 24) % 100), ui16_delta_time);
+  }
+  check_energy ("long ride");
+}
+
+// configuration saves call battery_soc_configure () again: the coulomb count must be kept unless the battery
+// configuration changed
+static void test_soc_configure (void)
+{
+  uint16_t ui16_package;
+  uint16_t ui16_soc_ocv_x10;
+  uint16_t ui16_soc_x10;
+
+  // 13S 500 Wh battery at 3.6 V per cell (542 ADC units) with 10 A and 0.2 ohm: 2 V of voltage sag
+  battery_soc_configure (13, 200, 5000);
+  package (519, 50, 49);
+  ui16_soc_ocv_x10 = battery_soc_get_x10 ();
+  CHECK (ui16_soc_ocv_x10 >= 390);
+  CHECK (ui16_soc_ocv_x10 <= 410);
+
+  // 10 minutes at 10 A: 1.67 Ah of 10.7 Ah
+  for (ui16_package = 0; ui16_package < 12000; ui16_package++) { package (519, 50, 49); }
+  ui16_soc_x10 = battery_soc_get_x10 ();
+  CHECK (ui16_soc_x10 >= (ui16_soc_ocv_x10 - 165));
+  CHECK (ui16_soc_x10 <= (ui16_soc_ocv_x10 - 150));
+
+  // other configuration saved
+  battery_soc_configure (13, 200, 5000);
+  package (519, 50, 49);
+  CHECK (battery_soc_get_x10 () <= ui16_soc_x10);
+  CHECK (battery_soc_get_x10 () >= (ui16_soc_x10 - 1));
+
+  // new battery capacity: start again from the OCV curve
+  battery_soc_configure (13, 200, 6000);
+  package (519, 50, 49);
+  CHECK_EQUAL (battery_soc_get_x10 (), ui16_soc_ocv_x10);
+}
+
+int main (void)
+{
+  test_constant_power ();
+  test_stop_and_go ();
+  test_long_ride ();
+  test_soc_configure ();
+
+  return TEST_RESULT ("test_battery");
+}
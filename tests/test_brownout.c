@@ -0,0 +1,178 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "config.h"
+#include "brownout.h"
+#include "test.h"
+
+// Power fail detection against voltage profiles: clock_brownout () is called every 1 ms with the battery voltage
+// of the profile, the ADC, EEPROM and LCD calls are stubs that count the calls.
+#define ADC_BATTERY_VOLTAGE       600     // LCD ADC units of the battery voltage when riding
+
+static uint16_t ui16_adc_battery_voltage;
+static uint16_t ui16_journal_stages;
+static uint16_t ui16_journal_writes;
+static uint16_t ui16_write_retries;
+static uint16_t ui16_backlight_off;
+static uint32_t ui32_time;
+
+uint16_t ui16_adc_read_battery_voltage_10b (void)
+{
+  return ui16_adc_battery_voltage;
+}
+
+void eeprom_journal_stage (uint32_t ui32_wh_x10)
+{
+  (void) ui32_wh_x10;
+  ui16_journal_stages++;
+}
+
+void eeprom_journal_write_staged (void)
+{
+  ui16_journal_writes++;
+}
+
+void eeprom_write_retry (void)
+{
+  ui16_write_retries++;
+}
+
+uint32_t lcd_get_wh_x10 (void)
+{
+  return 0;
+}
+
+void lcd_set_backlight_intensity (uint8_t ui8_intensity)
+{
+  if (ui8_intensity == 0) { ui16_backlight_off++; }
+}
+
+static void run (uint16_t ui16_voltage, uint32_t ui32_milliseconds)
+{
+  for (; ui32_milliseconds > 0; ui32_milliseconds--)
+  {
+    ui16_adc_battery_voltage = ui16_voltage;
+    clock_brownout ();
+    ui32_time++;
+  }
+}
+
+static void counters_reset (void)
+{
+  ui16_journal_stages = 0;
+  ui16_journal_writes = 0;
+  ui16_write_retries = 0;
+  ui16_backlight_off = 0;
+}
+
+// riding with the motor load changing: 10 % of voltage sag on each acceleration
+static void test_riding (void)
+{
+  uint8_t ui8_i;
+
+  counters_reset ();
+  for (ui8_i = 0; ui8_i < 10; ui8_i++)
+  {
+    run (ADC_BATTERY_VOLTAGE, 2000);
+    run ((ADC_BATTERY_VOLTAGE * 9) / 10, 1000);
+  }
+
+  CHECK_EQUAL (ui16_journal_writes, 0);
+  // the record is prepared every second
+  CHECK (ui16_journal_stages >= ((30000 / BROWNOUT_STAGE_PERIOD) - 1));
+  CHECK (ui16_journal_stages <= (30000 / BROWNOUT_STAGE_PERIOD));
+}
+
+// the battery is disconnected: the voltage decays to 0 in 20 ms, the record must be written once,
+// right after BROWNOUT_SAMPLES samples under the threshold
+static void test_decay_ramp (void)
+{
+  uint16_t ui16_voltage;
+  uint32_t ui32_threshold_time = 0;
+  uint32_t ui32_write_time = 0;
+
+  run (ADC_BATTERY_VOLTAGE, 2000);
+  counters_reset ();
+
+  for (ui16_voltage = ADC_BATTERY_VOLTAGE; ui16_voltage > 0; ui16_voltage -= 30)
+  {
+    if ((ui32_threshold_time == 0) && (ui16_voltage < (ADC_BATTERY_VOLTAGE - (ADC_BATTERY_VOLTAGE >> BROWNOUT_VOLTAGE_DROP_SHIFT))))
+    {
+      ui32_threshold_time = ui32_time;
+    }
+    run (ui16_voltage, 1);
+    if (ui16_journal_writes && (ui32_write_time == 0)) { ui32_write_time = ui32_time; }
+  }
+  run (0, 100);
+
+  CHECK_EQUAL (ui16_journal_writes, 1);
+  CHECK_EQUAL (ui16_backlight_off, 1);
+  CHECK_EQUAL (ui32_write_time - ui32_threshold_time, BROWNOUT_SAMPLES);
+  CHECK_EQUAL (ui16_journal_stages, 0);
+
+  // power is back (it was a long sag): monitoring again after BROWNOUT_RECOVER_TIME, and the configuration save
+  // dropped by the power fail detection is done again
+  CHECK_EQUAL (ui16_write_retries, 0);
+  run (ADC_BATTERY_VOLTAGE, BROWNOUT_RECOVER_TIME + 1);
+  CHECK_EQUAL (ui16_write_retries, 1);
+  counters_reset ();
+  run (ADC_BATTERY_VOLTAGE, 100);
+  run (0, 10);
+  CHECK_EQUAL (ui16_journal_writes, 1);
+  run (ADC_BATTERY_VOLTAGE, BROWNOUT_RECOVER_TIME + 1);
+}
+
+// a brief sag shorter than BROWNOUT_SAMPLES samples, like a motor current peak or noise, must not trigger
+static void test_brief_sag (void)
+{
+  uint8_t ui8_i;
+
+  run (ADC_BATTERY_VOLTAGE, 2000);
+  counters_reset ();
+
+  for (ui8_i = 0; ui8_i < 20; ui8_i++)
+  {
+    run (ADC_BATTERY_VOLTAGE / 2, BROWNOUT_SAMPLES - 1);
+    run (ADC_BATTERY_VOLTAGE, 200);
+  }
+
+  CHECK_EQUAL (ui16_journal_writes, 0);
+  CHECK_EQUAL (ui16_backlight_off, 0);
+}
+
+// the battery discharging, even fast under a high load, is followed by the reference and must not trigger:
+// from full to empty 13S battery (54.6 V to 39 V) in 10 minutes
+static void test_slow_discharge (void)
+{
+  uint32_t ui32_millisecond;
+
+  run (ADC_BATTERY_VOLTAGE, 2000);
+  counters_reset ();
+
+  for (ui32_millisecond = 0; ui32_millisecond < 600000; ui32_millisecond++)
+  {
+    run ((uint16_t) (ADC_BATTERY_VOLTAGE - ((ui32_millisecond * ((ADC_BATTERY_VOLTAGE * 156) / 546)) / 600000)), 1);
+  }
+
+  CHECK_EQUAL (ui16_journal_writes, 0);
+  CHECK_EQUAL (ui16_backlight_off, 0);
+}
+
+int main (void)
+{
+  brownout_init ();
+
+  test_riding ();
+  test_decay_ramp ();
+  test_brief_sag ();
+  test_slow_discharge ();
+
+  return TEST_RESULT ("test_brownout");
+}
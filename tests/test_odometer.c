@@ -0,0 +1,161 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "lcd.h"
+#include "odometer.h"
+#include "test.h"
+
+// Odometer with the wheel speed sensor tick counter received as the motor controller sends it: the 3 bytes on
+// 3 different packages (ids 2, 3 and 4 of 5), so the values are torn when a byte wraps between the packages.
+// The distance must be the real one and the speed must not have spikes.
+#define PACKAGE_TIME        49      // TIM3 ticks (1.024 ms) between packages
+#define PACKAGE_IDS         5
+#define WHEEL_PERIMETER     2050
+
+static uint16_t ui16_tim3_counter;
+static struct_configuration_variables configuration_variables;
+
+uint16_t TIM3_GetCounter (void)
+{
+  return ui16_tim3_counter;
+}
+
+struct_configuration_variables* get_configuration_variables (void)
+{
+  return &configuration_variables;
+}
+
+// the wheel and the motor controller
+static uint32_t ui32_wheel_ticks;             // real ticks since the start of the test
+static uint32_t ui32_wheel_distance_um;       // of the current wheel turn
+static uint32_t ui32_controller_tick_counter; // 24 bits
+static uint8_t ui8_package_id;
+static uint32_t ui32_received_tick_counter;
+static uint16_t ui16_max_speed_x10;
+
+static void ride (uint32_t ui32_speed_um_per_tick, uint32_t ui32_time)
+{
+  uint16_t ui16_time;
+  uint8_t ui8_byte;
+
+  for (; ui32_time >= PACKAGE_TIME; ui32_time -= PACKAGE_TIME)
+  {
+    for (ui16_time = 0; ui16_time < PACKAGE_TIME; ui16_time++)
+    {
+      ui16_tim3_counter++;
+      ui32_wheel_distance_um += ui32_speed_um_per_tick;
+      if (ui32_wheel_distance_um >= (WHEEL_PERIMETER * 1000))
+      {
+        ui32_wheel_distance_um -= WHEEL_PERIMETER * 1000;
+        ui32_wheel_ticks++;
+        ui32_controller_tick_counter = (ui32_controller_tick_counter + 1) & 0xffffff;
+      }
+    }
+
+    // the same as uart.c
+    ui8_package_id = (ui8_package_id + 1) % PACKAGE_IDS;
+    if ((ui8_package_id >= 2) && (ui8_package_id <= 4))
+    {
+      ui8_byte = (uint8_t) (ui32_controller_tick_counter >> ((ui8_package_id - 2) * 8));
+      if (ui8_package_id == 2) { ui32_received_tick_counter = ui8_byte; }
+      else { ui32_received_tick_counter |= ((uint32_t) ui8_byte) << ((ui8_package_id - 2) * 8); }
+      if (ui8_package_id == 4) { odometer_update (ui32_received_tick_counter); }
+    }
+
+    odometer_speed_update (ui32_speed_um_per_tick ? 250 : 0);
+    if (odometer_get_speed_x10 () > ui16_max_speed_x10) { ui16_max_speed_x10 = odometer_get_speed_x10 (); }
+  }
+}
+
+// the odometer is updated only every 5 packages and the last ticks may still not be received, and the remainder
+// under 0.1 km of the previous test is kept, so it can be 0.1 km different from the real distance
+static void check_distance (uint32_t ui32_odometer_start_x10)
+{
+  uint32_t ui32_expected_x10 = (ui32_wheel_ticks * WHEEL_PERIMETER) / 100000;
+  uint32_t ui32_distance_x10 = configuration_variables.ui32_odometer_x10 - ui32_odometer_start_x10;
+
+  CHECK (ui32_distance_x10 <= (ui32_expected_x10 + 1));
+  CHECK (ui32_distance_x10 >= (ui32_expected_x10 - 1));
+  if ((ui32_distance_x10 > (ui32_expected_x10 + 1)) || (ui32_distance_x10 < (ui32_expected_x10 - 1)))
+  {
+    printf ("odometer %u.%u km, real distance %u.%u km\n", (unsigned) (ui32_distance_x10 / 10), (unsigned) (ui32_distance_x10 % 10),
+        (unsigned) (ui32_expected_x10 / 10), (unsigned) (ui32_expected_x10 % 10));
+  }
+}
+
+static void ride_start (uint32_t ui32_controller_tick_counter_start)
+{
+  ui32_wheel_ticks = 0;
+  ui32_controller_tick_counter = ui32_controller_tick_counter_start;
+  ui16_max_speed_x10 = 0;
+}
+
+// 1 hour at 25 km/h (7.111 mm per TIM3 tick): the low byte wraps 47 times and the middle byte once.
+// With an odometer update every 5 packages the speed resolution is about 3 km/h, a torn value would be hundreds.
+static void test_torn_values (void)
+{
+  uint32_t ui32_odometer_start_x10;
+
+  ride_start (0x00ff00);
+  ride (0, PACKAGE_TIME * PACKAGE_IDS * 2);
+  ui32_odometer_start_x10 = configuration_variables.ui32_odometer_x10;
+
+  ride (7111, 3515625);
+  check_distance (ui32_odometer_start_x10);
+  CHECK (ui16_max_speed_x10 <= 300);
+}
+
+// the 24 bits counter wraps around
+static void test_counter_wrap (void)
+{
+  uint32_t ui32_odometer_start_x10 = configuration_variables.ui32_odometer_x10;
+
+  ride_start (0xfffe00);
+  ride (7111, 351562);
+  check_distance (ui32_odometer_start_x10);
+  CHECK (ui16_max_speed_x10 <= 300);
+}
+
+// the motor controller is reset while riding: no packages for 2 seconds and the counter starts again from 0
+static void test_controller_reset (void)
+{
+  uint32_t ui32_odometer_start_x10 = configuration_variables.ui32_odometer_x10;
+  uint16_t ui16_time;
+
+  ride_start (0x12f0f0);
+  ride (7111, 351562);
+
+  ui32_controller_tick_counter = 0;
+  for (ui16_time = 0; ui16_time < 1953; ui16_time++)
+  {
+    ui16_tim3_counter++;
+    ui32_wheel_distance_um += 7111;
+    if (ui32_wheel_distance_um >= (WHEEL_PERIMETER * 1000))
+    {
+      ui32_wheel_distance_um -= WHEEL_PERIMETER * 1000;
+      ui32_wheel_ticks++;
+      ui32_controller_tick_counter++;
+    }
+  }
+
+  ride (7111, 351562);
+  check_distance (ui32_odometer_start_x10);
+}
+
+int main (void)
+{
+  configuration_variables.ui16_wheel_perimeter = WHEEL_PERIMETER;
+
+  test_torn_values ();
+  test_counter_wrap ();
+  test_controller_reset ();
+
+  return TEST_RESULT ("test_odometer");
+}
@@ -7,6 +7,7 @@
  */
 
 #include "stm8s.h"
+#include "main.h"
 #include "stm8s_tim1.h"
 #include "stm8s_tim3.h"
 
@@ -25,12 +26,35 @@ void timer3_init (void)
   // TIM3 Peripheral Configuration
   TIM3_DeInit();
   TIM3_TimeBaseInit(TIM3_PRESCALER_16384, 0xffff); // each incremment at every ~1ms
+
+  // compare interrupt on every counter increment, to wake up the CPU from wfi on main loop
+  TIM3_SetCompare1(1);
+  TIM3_ITConfig(TIM3_IT_CC1, ENABLE);
+
   TIM3_Cmd(ENABLE); // TIM3 counter enable
 
   // IMPORTANT: this software delay is needed so timer3 work after this
   for(ui16_i = 0; ui16_i < (29000); ui16_i++) { ; }
 }
 
+// TIM3 compare: next interrupt on next counter increment, from the counter value and not from the previous compare
+// value: if this interrupt is served late, like with interrupts disabled for more than 1ms, the previous compare
+// value + 1 could be already behind the counter and there would be no interrupt until the counter wraps
+void TIM3_CAP_COM_IRQHandler(void) __interrupt(TIM3_CAP_COM_IRQHANDLER)
+{
+  uint16_t ui16_compare;
+
+  // registers read directly, no function calls on interrupts: TIM3 counter high byte must be read first, the low
+  // byte is latched
+  ui16_compare = ((uint16_t) TIM3->CNTRH) << 8;
+  ui16_compare |= TIM3->CNTRL;
+  ui16_compare++;
+  TIM3->CCR1H = (uint8_t) (ui16_compare >> 8);
+  TIM3->CCR1L = (uint8_t) ui16_compare;
+
+  TIM3->SR1 = (uint8_t) ~TIM3_SR1_CC1IF;
+}
+
 // Timer1 is used to create a PWM duty-cyle signal to control LCD backlight
 void timer1_init (void)
 {
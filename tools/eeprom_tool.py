@@ -0,0 +1,583 @@
+#!/usr/bin/env python3
+#
+# LCD3 firmware
+#
+# Copyright (C) Casainho, 2018.
+#
+# Released under the GPL License, Version 3
+#
+# Host tool for the data EEPROM of the LCD3: decodes an EEPROM dump to a text configuration, validates it and
+# builds a new EEPROM image to program with stm8flash.
+#
+# The configuration variables, their EEPROM layout, default values and valid ranges are not repeated here: they
+# are read from the firmware sources, the schema table of eeprom.c, struct_configuration_variables of lcd.h and
+# the defines of eeprom.h, main.h and filter.h, so the tool always matches the firmware of the same tree.
+#
+# Read the EEPROM:    stm8flash -cstlinkv2 -pstm8s105?4 -s eeprom -r dump.bin
+# Show it:            tools/eeprom_tool.py decode dump.bin
+# Change values:      tools/eeprom_tool.py build --base dump.bin -s ui16_wheel_perimeter=2100 -o eeprom.hex
+# New bike:           tools/eeprom_tool.py build bike.txt -o eeprom.hex
+# Write the EEPROM:   stm8flash -cstlinkv2 -pstm8s105?4 -s eeprom -w eeprom.hex
+#
+# Configuration text: one "variable = value" per line, "#" starts a comment; values of profiles 1 to 3 that are
+# different from profile 0 use "profile<n>.variable = value". Variables not on the text keep their default value,
+# or the value of the --base dump.
+
+import argparse
+import ast
+import operator
+import os
+import re
+import sys
+
+SOURCE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+EEPROM_START = 0x4000
+EEPROM_SIZE = 1024  # STM8S105: 0x4000 to 0x43FF
+
+TYPE_SIZES = {"uint8_t": 1, "uint16_t": 2, "uint32_t": 4}
+
+
+class ToolError(Exception):
+    pass
+
+
+def read_source(name):
+    with open(os.path.join(SOURCE_DIR, name)) as f:
+        return f.read()
+
+
+def strip_comments(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    return re.sub(r"//[^\n]*", "", text)
+
+
+class Defines:
+    """#define values of the firmware headers, evaluated as integer expressions"""
+
+    OPERATORS = {
+        ast.Add: operator.add, ast.Sub: operator.sub, ast.Mult: operator.mul, ast.FloorDiv: operator.floordiv,
+        ast.Div: operator.floordiv, ast.LShift: operator.lshift, ast.RShift: operator.rshift,
+        ast.BitOr: operator.or_, ast.BitAnd: operator.and_, ast.USub: operator.neg,
+    }
+
+    def __init__(self, files):
+        self.text = {}
+        for name in files:
+            for line in strip_comments(read_source(name)).splitlines():
+                match = re.match(r"\s*#\s*define\s+(\w+)\s+(.+)$", line)
+                if match:
+                    self.text[match.group(1)] = match.group(2).strip()
+        self.extra = {}
+
+    def __setitem__(self, name, value):
+        self.extra[name] = value
+
+    def __getitem__(self, name):
+        return self.evaluate(name)
+
+    def evaluate(self, expression, depth=0):
+        if depth > 16:
+            raise ToolError("define loop: %s" % expression)
+        expression = expression.strip()
+        if expression in self.extra:
+            return self.extra[expression]
+        if expression in self.text:
+            return self.evaluate(self.text[expression], depth + 1)
+
+        # C casts and integer suffixes
+        expression = re.sub(r"\(\s*u?int\d+_t\s*\)", "", expression)
+        expression = re.sub(r"\b(0x[0-9a-fA-F]+|\d+)[uUlL]+\b", r"\1", expression)
+        expression = expression.replace("/", "//")
+
+        def node_value(node):
+            if isinstance(node, ast.Expression):
+                return node_value(node.body)
+            if isinstance(node, ast.Constant) and isinstance(node.value, int):
+                return node.value
+            if isinstance(node, ast.Name):
+                if node.id not in self.text and node.id not in self.extra:
+                    raise ToolError("unknown define: %s" % node.id)
+                return self.evaluate(node.id, depth + 1)
+            if isinstance(node, ast.BinOp) and type(node.op) in self.OPERATORS:
+                return self.OPERATORS[type(node.op)](node_value(node.left), node_value(node.right))
+            if isinstance(node, ast.UnaryOp) and type(node.op) in self.OPERATORS:
+                return self.OPERATORS[type(node.op)](node_value(node.operand))
+            raise ToolError("can't evaluate: %s" % expression)
+
+        try:
+            return node_value(ast.parse(expression, mode="eval"))
+        except SyntaxError:
+            raise ToolError("can't evaluate: %s" % expression)
+
+
+class Field:
+    def __init__(self, name, address, offset, size, eeprom_size, bit_shift, bit_mask, flags, default, minimum, maximum):
+        self.name = name
+        self.address = address
+        self.offset = offset
+        self.size = size
+        self.eeprom_size = eeprom_size
+        self.bit_shift = bit_shift
+        self.bit_mask = bit_mask
+        self.flags = flags
+        self.default = default
+        self.min = minimum
+        self.max = maximum
+
+
+class Schema:
+    """eeprom_schema [] of eeprom.c, with the variables offsets of struct_configuration_variables on the STM8"""
+
+    def __init__(self):
+        self.defines = Defines(["eeprom.h", "main.h", "filter.h", "config.h"])
+        self.variables = self.parse_struct()
+        self.fields = self.parse_schema()
+
+        d = self.defines
+        d["EEPROM_BYTES_STORED"] = self.variables["ui8_cruise_control"][0]
+        d["FLASH_BLOCK_SIZE"] = 128
+        self.bytes_stored = d["EEPROM_BYTES_STORED"]
+        if d["EEPROM_IMAGE_OFFSET_DATA"] + self.bytes_stored > d["FLASH_BLOCK_SIZE"]:
+            raise ToolError("configuration variables don't fit on the EEPROM image")
+        # the compile time checks of eeprom.c use these defines
+        profile_fields = self.profile_fields()
+        if len(profile_fields) != d["PROFILE_FIELDS"] or \
+                sum(field.size for field in profile_fields) != d["PROFILE_DATA_SIZE"]:
+            raise ToolError("PROFILE_FIELDS and PROFILE_DATA_SIZE of eeprom.h don't match the schema: %d fields, "
+                            "%d bytes" % (len(profile_fields), sum(field.size for field in profile_fields)))
+
+    def parse_struct(self):
+        """offset and size of each struct_configuration_variables member: SDCC doesn't add padding"""
+        text = strip_comments(read_source("lcd.h"))
+        match = re.search(r"typedef struct _configuration_variables\s*\{(.*?)\}\s*struct_configuration_variables;",
+                          text, re.S)
+        if not match:
+            raise ToolError("struct_configuration_variables not found on lcd.h")
+
+        variables = {}
+        offset = 0
+        for line in match.group(1).split(";"):
+            member = re.match(r"\s*(\w+)\s+(\w+)\s*(?:\[\s*(\d+)\s*\])?\s*$", line)
+            if not member:
+                continue
+            size = TYPE_SIZES[member.group(1)]
+            count = int(member.group(3)) if member.group(3) else 1
+            variables[member.group(2)] = (offset, size)
+            offset += size * count
+        return variables
+
+    def parse_schema(self):
+        text = strip_comments(read_source("eeprom.c"))
+        match = re.search(r"eeprom_schema\s*\[\]\s*=\s*\{(.*?)\};", text, re.S)
+        if not match:
+            raise ToolError("eeprom_schema not found on eeprom.c")
+
+        fields = []
+        for row in re.finditer(r"(EEPROM_FIELD(?:_BITS)?)\s*\(([^()]*)\)", match.group(1)):
+            args = [arg.strip() for arg in row.group(2).split(",")]
+            variable = re.match(r"(\w+)\s*(?:\[\s*(\d+)\s*\])?$", args[1])
+            offset, size = self.variables[variable.group(1)]
+            name = variable.group(1)
+            if variable.group(2):
+                offset += size * int(variable.group(2))
+                name += "[%s]" % variable.group(2)
+
+            evaluate = self.defines.evaluate
+            if row.group(1) == "EEPROM_FIELD":
+                # address, variable, eeprom_size, flags, default, min, max
+                fields.append(Field(name, int(args[0]), offset, size, evaluate(args[2]), 0, 0, evaluate(args[3]),
+                                    evaluate(args[4]), evaluate(args[5]), evaluate(args[6])))
+            else:
+                # address, variable, bit_shift, bit_mask, default, max
+                fields.append(Field(name, int(args[0]), offset, size, 1, evaluate(args[2]), evaluate(args[3]), 0,
+                                    evaluate(args[4]), 0, evaluate(args[5])))
+        return fields
+
+    def field(self, name):
+        for field in self.fields:
+            if field.name == name:
+                return field
+        raise ToolError("unknown variable: %s" % name)
+
+    def profile_fields(self):
+        return [field for field in self.fields if field.flags & self.defines["EEPROM_FIELD_PROFILE"]]
+
+
+def crc16(data, crc=0xffff):
+    # same as crc16 () of utils.c
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xa001 if crc & 1 else crc >> 1
+    return crc
+
+
+def get_uint(data, offset, size, big_endian):
+    return int.from_bytes(bytes(data[offset:offset + size]), "big" if big_endian else "little")
+
+
+def set_uint(data, offset, size, value, big_endian):
+    data[offset:offset + size] = value.to_bytes(size, "big" if big_endian else "little")
+
+
+class Configuration:
+    """values of the configuration variables, profile 0, and the values of the other profiles that are different"""
+
+    def __init__(self, schema):
+        self.schema = schema
+        self.values = dict((field.name, field.default) for field in schema.fields)
+        self.profiles = dict((profile, {}) for profile in range(1, schema.defines["EEPROM_PROFILES"]))
+        self.notes = []
+
+    def set(self, name, text):
+        profile = 0
+        match = re.match(r"profile(\d+)\.(.+)$", name)
+        if match:
+            profile = int(match.group(1))
+            name = match.group(2)
+            if profile not in self.profiles:
+                raise ToolError("invalid profile: %d" % profile)
+
+        field = self.schema.field(name)
+        try:
+            value = int(text, 0)
+        except ValueError:
+            raise ToolError("invalid value for %s: %s" % (name, text))
+
+        if profile:
+            if not field.flags & self.schema.defines["EEPROM_FIELD_PROFILE"]:
+                raise ToolError("%s is not a profile variable" % name)
+            self.profiles[profile][name] = value
+        else:
+            self.values[name] = value
+
+    def errors(self):
+        errors = []
+        for field in self.schema.fields:
+            values = [("", self.values[field.name])]
+            values += [("profile%d." % profile, deltas[field.name])
+                       for profile, deltas in self.profiles.items() if field.name in deltas]
+            for prefix, value in values:
+                if value < field.min or value > field.max:
+                    errors.append("%s%s = %d: valid range is %d to %d" %
+                                  (prefix, field.name, value, field.min, field.max))
+        return errors
+
+    # EEPROM dump
+
+    def decode(self, eeprom):
+        d = self.schema.defines
+
+        # image in use, like eeprom_init ()
+        images = [address for address in (d["EEPROM_IMAGE_A_ADDRESS"], d["EEPROM_IMAGE_B_ADDRESS"])
+                  if self.image_valid(eeprom, address)]
+        if len(images) == 2:
+            sequence_a = eeprom[images[0] - EEPROM_START + d["EEPROM_IMAGE_OFFSET_SEQUENCE"]]
+            sequence_b = eeprom[images[1] - EEPROM_START + d["EEPROM_IMAGE_OFFSET_SEQUENCE"]]
+            images = [images[1]] if ((sequence_b - sequence_a) & 255) < 128 else [images[0]]
+
+        journal = True
+        if images:
+            start = images[0] - EEPROM_START
+            version = eeprom[start + d["EEPROM_IMAGE_OFFSET_VERSION"]]
+            length = eeprom[start + d["EEPROM_IMAGE_OFFSET_LENGTH"]]
+            data = start + d["EEPROM_IMAGE_OFFSET_DATA"]
+            self.notes.append("image %s, version %d, sequence %d" %
+                              ("A" if images[0] == d["EEPROM_IMAGE_A_ADDRESS"] else "B", version,
+                               eeprom[start + d["EEPROM_IMAGE_OFFSET_SEQUENCE"]]))
+        else:
+            version = 0
+            data = d["EEPROM_BASE_ADDRESS"] - EEPROM_START
+            if eeprom[data] == d["EEPROM_LEGACY_KEY"]:
+                length = d["EEPROM_LEGACY_BYTES_STORED"]
+                journal = False
+            else:
+                length = 0
+                journal = False
+            self.notes.append("no valid image, %s" % ("previous firmware data" if length else "default values"))
+
+        # like eeprom_read_values_to_variables ()
+        for field in self.schema.fields:
+            if version == d["EEPROM_IMAGE_VERSION"]:
+                stored = field.offset + field.size <= length
+                value = get_uint(eeprom, data + field.offset, field.size, True) if stored else 0
+            else:
+                stored = field.address + field.eeprom_size <= length
+                value = get_uint(eeprom, data + field.address, field.eeprom_size, False) if stored else 0
+                if field.bit_mask:
+                    value = (value >> field.bit_shift) & field.bit_mask
+            if not stored:
+                value = field.default
+            elif value < field.min or value > field.max:
+                self.notes.append("%s = %d out of the valid range, default value used" % (field.name, value))
+                value = field.default
+            self.values[field.name] = value
+
+        if journal:
+            self.decode_journal(eeprom)
+        self.decode_profiles(eeprom)
+
+    def image_valid(self, eeprom, address):
+        d = self.schema.defines
+        start = address - EEPROM_START
+        length = eeprom[start + d["EEPROM_IMAGE_OFFSET_LENGTH"]]
+        if eeprom[start + d["EEPROM_IMAGE_OFFSET_MAGIC"]] != d["EEPROM_IMAGE_MAGIC"] or \
+                eeprom[start + d["EEPROM_IMAGE_OFFSET_VERSION"]] != d["EEPROM_IMAGE_VERSION"] or \
+                length > d["FLASH_BLOCK_SIZE"] - d["EEPROM_IMAGE_OFFSET_DATA"]:
+            return False
+        crc = crc16(eeprom[start:start + d["EEPROM_IMAGE_OFFSET_CRC"]])
+        data = start + d["EEPROM_IMAGE_OFFSET_DATA"]
+        crc = crc16(eeprom[data:data + length], crc)
+        return get_uint(eeprom, start + d["EEPROM_IMAGE_OFFSET_CRC"], 2, False) == crc
+
+    def journal_fields(self):
+        # record data of journal_build ()
+        return [("ui32_wh_x10_offset", 0, 4), ("ui32_odometer_x10", 4, 4), ("ui32_trip_moving_time_seconds", 8, 4),
+                ("ui32_trip_total_time_seconds", 12, 4), ("ui32_trip_energy_ws", 16, 4),
+                ("ui16_odometer_distance_x10", 20, 2), ("ui16_trip_max_speed_x10", 22, 2)]
+
+    def decode_journal(self, eeprom):
+        d = self.schema.defines
+        newest = None
+        for slot in range(d["EEPROM_JOURNAL_SLOTS"]):
+            start = d["EEPROM_JOURNAL_BASE_ADDRESS"] - EEPROM_START + slot * d["EEPROM_JOURNAL_SLOT_SIZE"]
+            record = eeprom[start:start + d["JOURNAL_RECORD_SIZE"]]
+            if record[d["JOURNAL_OFFSET_KEY"]] != d["JOURNAL_KEY"] or \
+                    get_uint(record, d["JOURNAL_OFFSET_CRC"], 2, False) != crc16(record[:d["JOURNAL_OFFSET_CRC"]]):
+                continue
+            sequence = get_uint(record, d["JOURNAL_OFFSET_SEQUENCE"], 4, False)
+            if newest is None or sequence > newest[0]:
+                newest = (sequence, record)
+
+        if newest is None:
+            return
+        self.notes.append("journal record %d" % newest[0])
+        for name, offset, size in self.journal_fields():
+            self.values[name] = get_uint(newest[1], d["JOURNAL_OFFSET_DATA"] + offset, size, False)
+
+    def profile_slot(self, profile, slot):
+        # slot 0 is the slot A of the profile and slot 1 the slot B
+        d = self.schema.defines
+        return d["EEPROM_PROFILES_BASE_ADDRESS"] - EEPROM_START + ((profile - 1) * 2 + slot) * d["EEPROM_PROFILE_SLOT_SIZE"]
+
+    def profile_record(self, eeprom, profile):
+        # like profile_record_load (): the valid record of slots A and B, the newest if both are valid
+        d = self.schema.defines
+        records = []
+        for slot in range(2):
+            start = self.profile_slot(profile, slot)
+            record = eeprom[start:start + d["EEPROM_PROFILE_SLOT_SIZE"]]
+            if record[d["PROFILE_OFFSET_KEY"]] == d["PROFILE_KEY"] and \
+                    get_uint(record, d["PROFILE_OFFSET_CRC"], 2, False) == crc16(record[:d["PROFILE_OFFSET_CRC"]]):
+                records.append(record)
+        if len(records) == 2:
+            sequence = d["PROFILE_OFFSET_SEQUENCE"]
+            return records[1] if ((records[1][sequence] - records[0][sequence]) & 255) < 128 else records[0]
+        return records[0] if records else None
+
+    def decode_profiles(self, eeprom):
+        # like profile_apply ()
+        d = self.schema.defines
+        for profile in self.profiles:
+            record = self.profile_record(eeprom, profile)
+            if record is None:
+                continue
+            data = d["PROFILE_OFFSET_DATA"]
+            for bit, field in enumerate(self.schema.profile_fields()):
+                if record[d["PROFILE_OFFSET_BITMAP"] + (bit >> 3)] & (1 << (bit & 7)):
+                    self.profiles[profile][field.name] = get_uint(record, data, field.size, True)
+                    data += field.size
+
+    def encode(self):
+        """EEPROM with the image A and the profiles on their slot A, image B, the slots B and the journal are erased"""
+        d = self.schema.defines
+        eeprom = bytearray(EEPROM_SIZE)
+
+        start = d["EEPROM_IMAGE_A_ADDRESS"] - EEPROM_START
+        data = start + d["EEPROM_IMAGE_OFFSET_DATA"]
+        for field in self.schema.fields:
+            set_uint(eeprom, data + field.offset, field.size, self.values[field.name], True)
+        eeprom[start + d["EEPROM_IMAGE_OFFSET_MAGIC"]] = d["EEPROM_IMAGE_MAGIC"]
+        eeprom[start + d["EEPROM_IMAGE_OFFSET_VERSION"]] = d["EEPROM_IMAGE_VERSION"]
+        eeprom[start + d["EEPROM_IMAGE_OFFSET_LENGTH"]] = self.schema.bytes_stored
+        eeprom[start + d["EEPROM_IMAGE_OFFSET_SEQUENCE"]] = 1
+        crc = crc16(eeprom[start:start + d["EEPROM_IMAGE_OFFSET_CRC"]])
+        crc = crc16(eeprom[data:data + self.schema.bytes_stored], crc)
+        set_uint(eeprom, start + d["EEPROM_IMAGE_OFFSET_CRC"], 2, crc, False)
+
+        # like profile_write ()
+        for profile, deltas in self.profiles.items():
+            record = bytearray(d["EEPROM_PROFILE_SLOT_SIZE"])
+            record[d["PROFILE_OFFSET_KEY"]] = d["PROFILE_KEY"]
+            data = d["PROFILE_OFFSET_DATA"]
+            for bit, field in enumerate(self.schema.profile_fields()):
+                if field.name in deltas and deltas[field.name] != self.values[field.name]:
+                    record[d["PROFILE_OFFSET_BITMAP"] + (bit >> 3)] |= 1 << (bit & 7)
+                    set_uint(record, data, field.size, deltas[field.name], True)
+                    data += field.size
+            if data == d["PROFILE_OFFSET_DATA"]:
+                continue
+            if data > d["PROFILE_OFFSET_CRC"]:
+                raise ToolError("profile %d: too many values" % profile)
+            set_uint(record, d["PROFILE_OFFSET_CRC"], 2, crc16(record[:d["PROFILE_OFFSET_CRC"]]), False)
+            start = self.profile_slot(profile, 0)
+            eeprom[start:start + len(record)] = record
+
+        return eeprom
+
+    # configuration text
+
+    def to_text(self):
+        lines = ["# %s" % note for note in self.notes]
+        for field in self.schema.fields:
+            lines.append("%s = %d" % (field.name, self.values[field.name]))
+        for profile, deltas in self.profiles.items():
+            for field in self.schema.profile_fields():
+                if field.name in deltas and deltas[field.name] != self.values[field.name]:
+                    lines.append("profile%d.%s = %d" % (profile, field.name, deltas[field.name]))
+        return "\n".join(lines) + "\n"
+
+    def from_text(self, text, source):
+        for number, line in enumerate(text.splitlines(), 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            if "=" not in line:
+                raise ToolError("%s:%d: expected variable = value" % (source, number))
+            name, value = line.split("=", 1)
+            try:
+                self.set(name.strip(), value.strip())
+            except ToolError as error:
+                raise ToolError("%s:%d: %s" % (source, number, error))
+
+
+# EEPROM files: raw binary of the EEPROM, as read by stm8flash, or Intel HEX
+
+def read_eeprom(path):
+    eeprom = bytearray(EEPROM_SIZE)
+    if path.lower().endswith((".hex", ".ihx")):
+        base = 0
+        with open(path) as f:
+            for line in f:
+                line = line.strip()
+                if not line.startswith(":"):
+                    continue
+                record = bytes.fromhex(line[1:])
+                if sum(record) & 255:
+                    raise ToolError("%s: checksum error" % path)
+                length, address, kind = record[0], get_uint(record, 1, 2, True), record[3]
+                if kind == 0:
+                    address += base
+                    if address >= EEPROM_START:
+                        address -= EEPROM_START
+                    if address + length > EEPROM_SIZE:
+                        raise ToolError("%s: data outside of the EEPROM" % path)
+                    eeprom[address:address + length] = record[4:4 + length]
+                elif kind == 2:
+                    base = get_uint(record, 4, 2, True) << 4
+                elif kind == 4:
+                    base = get_uint(record, 4, 2, True) << 16
+    else:
+        with open(path, "rb") as f:
+            data = f.read()
+        if len(data) > EEPROM_SIZE:
+            raise ToolError("%s: bigger than the EEPROM" % path)
+        eeprom[:len(data)] = data
+    return eeprom
+
+
+def write_eeprom(path, eeprom):
+    if path.lower().endswith((".hex", ".ihx")):
+        lines = []
+        for offset in range(0, len(eeprom), 16):
+            address = EEPROM_START + offset
+            record = bytes([16, address >> 8, address & 255, 0]) + bytes(eeprom[offset:offset + 16])
+            lines.append(":%s%02X" % (record.hex().upper(), -sum(record) & 255))
+        lines.append(":00000001FF")
+        with open(path, "w") as f:
+            f.write("\n".join(lines) + "\n")
+    else:
+        with open(path, "wb") as f:
+            f.write(eeprom)
+
+
+def command_decode(schema, args):
+    configuration = Configuration(schema)
+    configuration.decode(read_eeprom(args.dump))
+    text = configuration.to_text()
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+    return 0
+
+
+def command_validate(schema, args):
+    configuration = Configuration(schema)
+    if args.file.lower().endswith((".hex", ".ihx", ".bin")):
+        configuration.decode(read_eeprom(args.file))
+        problems = [note for note in configuration.notes if "default" in note]
+    else:
+        with open(args.file) as f:
+            configuration.from_text(f.read(), args.file)
+        problems = configuration.errors()
+
+    for problem in problems:
+        print(problem)
+    return 1 if problems else 0
+
+
+def command_build(schema, args):
+    configuration = Configuration(schema)
+    if args.base:
+        configuration.decode(read_eeprom(args.base))
+    if args.config:
+        with open(args.config) as f:
+            configuration.from_text(f.read(), args.config)
+    for assignment in args.set:
+        if "=" not in assignment:
+            raise ToolError("expected variable=value: %s" % assignment)
+        name, value = assignment.split("=", 1)
+        configuration.set(name.strip(), value.strip())
+
+    errors = configuration.errors()
+    if errors:
+        raise ToolError("\n".join(errors))
+
+    write_eeprom(args.output, configuration.encode())
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="LCD3 data EEPROM tool")
+    commands = parser.add_subparsers(dest="command")
+    commands.required = True
+
+    decode = commands.add_parser("decode", help="EEPROM dump (.bin or .hex) to configuration text")
+    decode.add_argument("dump")
+    decode.add_argument("-o", "--output", help="configuration text file, default is the standard output")
+    decode.set_defaults(function=command_decode)
+
+    validate = commands.add_parser("validate", help="check an EEPROM dump or a configuration text")
+    validate.add_argument("file")
+    validate.set_defaults(function=command_validate)
+
+    build = commands.add_parser("build", help="EEPROM image (.bin or .hex) from configuration text and values")
+    build.add_argument("config", nargs="?", help="configuration text file")
+    build.add_argument("-b", "--base", help="EEPROM dump with the initial values, default is the default values")
+    build.add_argument("-s", "--set", action="append", default=[], metavar="VARIABLE=VALUE")
+    build.add_argument("-o", "--output", required=True)
+    build.set_defaults(function=command_build)
+
+    args = parser.parse_args()
+    try:
+        return args.function(Schema(), args)
+    except (ToolError, OSError) as error:
+        sys.stderr.write("error: %s\n" % error)
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,279 @@
+#!/usr/bin/env python3
+#
+# LCD3 firmware
+#
+# Copyright (C) Casainho, 2018.
+#
+# Released under the GPL License, Version 3
+#
+# Flash and RAM usage of the firmware, per module and per function, from the files of the SDCC build: the linker
+# map (main.map) gives the areas of the memory and the global symbols of all the modules, including the ones of the
+# SDCC library (___divulong, ___fsmul, ...), and the listings relocated by the linker (*.rst) give the static
+# functions and variables of the firmware modules.
+#
+# The size of a symbol is the distance to the next symbol of the same area, so every byte of the areas is counted
+# once, on the function or variable it belongs to.
+#
+# Usage, after the build:
+#   tools/size_report.py --map main.map *.rst StdPeriphLib/src/*.rst
+#   tools/size_report.py --map main.map --budget tools/size_budget.txt --baseline tools/size_baseline.txt *.rst
+#   tools/size_report.py --map main.map --baseline tools/size_baseline.txt --update-baseline *.rst
+#
+# Exits with 1 if any usage is over the budget.
+
+import argparse
+import os
+import re
+import sys
+
+# STM8S105: areas of the linker on flash and RAM, the stack (SSEG) is shown but it is not on the budget
+FLASH_AREAS = ("HOME", "GSINIT", "GSFINAL", "CONST", "INITIALIZER", "CODE", "CABS")
+RAM_AREAS = ("DATA", "INITIALIZED")
+STACK_AREA = "SSEG"
+
+FUNCTIONS_SHOWN = 25
+
+
+class ToolError(Exception):
+    pass
+
+
+class Symbol:
+    def __init__(self, name, module, area, address):
+        self.name = name
+        self.module = module
+        self.area = area
+        self.address = address
+        self.size = 0
+
+
+class Area:
+    def __init__(self, name, address, size):
+        self.name = name
+        self.address = address
+        self.size = size
+
+
+def parse_map(path):
+    """areas and global symbols of the sdld map file"""
+    areas = {}
+    symbols = []
+    area = None
+
+    with open(path) as f:
+        for line in f:
+            match = re.match(r"^(\w+)\s+([0-9A-Fa-f]+)\s+([0-9A-Fa-f]+)\s+=\s+(\d+)\.\s+bytes", line)
+            if match:
+                area = Area(match.group(1), int(match.group(2), 16), int(match.group(4)))
+                areas[area.name] = area
+                continue
+
+            match = re.match(r"^\s+([0-9A-Fa-f]{4,8})\s+([A-Za-z_]\w*)\s+(\S+)\s*$", line)
+            if match and area:
+                symbols.append(Symbol(match.group(2), match.group(3), area.name, int(match.group(1), 16)))
+
+    if not areas:
+        raise ToolError("%s: no areas found, is it a SDCC map file?" % path)
+    return areas, symbols
+
+
+def parse_listing(path):
+    """labels of a relocated listing, with the area where they are defined"""
+    module = os.path.splitext(os.path.basename(path))[0]
+    symbols = []
+    area = None
+
+    with open(path) as f:
+        for line in f:
+            match = re.search(r"\.area\s+(\w+)", line)
+            if match and ";" not in line.split(".area")[0]:
+                area = match.group(1)
+                continue
+
+            # "      0080A0                        114 _clock_lcd:", local labels like 00101$ are not symbols
+            match = re.match(r"^\s*([0-9A-Fa-f]{4,8})\s.*?\s\d+\s+([A-Za-z_]\w*)::?\s*(;.*)?$", line)
+            if match and area:
+                symbols.append(Symbol(match.group(2), module, area, int(match.group(1), 16)))
+
+    return symbols
+
+
+def symbols_sizes(areas, symbols):
+    """the size of each symbol is up to the next symbol of the area or up to the end of the area"""
+    by_address = {}
+    for symbol in symbols:
+        if symbol.area not in areas:
+            continue
+        # the map has the globals, the listings also the statics, each symbol is counted only once
+        by_address.setdefault((symbol.area, symbol.address), symbol)
+
+    sized = []
+    for area in areas.values():
+        area_symbols = sorted((s for s in by_address.values() if s.area == area.name), key=lambda s: s.address)
+        end = area.address + area.size
+        for index, symbol in enumerate(area_symbols):
+            following = area_symbols[index + 1].address if index + 1 < len(area_symbols) else end
+            symbol.size = max(0, min(following, end) - symbol.address)
+            sized.append(symbol)
+
+        # bytes before the first symbol, like the interrupts table on HOME or the startup code on GSINIT
+        first = area_symbols[0].address if area_symbols else end
+        if first > area.address:
+            symbol = Symbol("(%s)" % area.name, "(startup)", area.name, area.address)
+            symbol.size = first - area.address
+            sized.append(symbol)
+
+    return sized
+
+
+class Usage:
+    """flash and RAM bytes of each module and function"""
+
+    def __init__(self, areas, symbols):
+        self.flash = sum(a.size for a in areas.values() if a.name in FLASH_AREAS)
+        self.ram = sum(a.size for a in areas.values() if a.name in RAM_AREAS)
+        self.stack = areas[STACK_AREA].size if STACK_AREA in areas else 0
+        self.modules = {}
+        self.functions = {}
+
+        for symbol in symbols:
+            flash = symbol.size if symbol.area in FLASH_AREAS else 0
+            ram = symbol.size if symbol.area in RAM_AREAS else 0
+            module = self.modules.setdefault(symbol.module, [0, 0])
+            module[0] += flash
+            module[1] += ram
+            if symbol.area in ("CODE", "CONST") and flash:
+                self.functions["%s:%s" % (symbol.module, symbol.name.lstrip("_"))] = flash
+
+    def values(self):
+        """name -> [flash, ram], as on the baseline file"""
+        values = {"total": [self.flash, self.ram]}
+        values.update(self.modules)
+        for name, flash in self.functions.items():
+            values[name] = [flash, 0]
+        return values
+
+
+def read_values(path):
+    """lines "name flash ram" of the budget and baseline files, "#" starts a comment"""
+    values = {}
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            fields = line.split("#")[0].split()
+            if not fields:
+                continue
+            if len(fields) != 3:
+                raise ToolError("%s:%d: expected name flash ram" % (path, number))
+            try:
+                values[fields[0]] = [int(fields[1], 0), int(fields[2], 0)]
+            except ValueError:
+                raise ToolError("%s:%d: invalid size" % (path, number))
+    return values
+
+
+def write_baseline(path, usage):
+    values = usage.values()
+    with open(path, "w") as f:
+        f.write("# Flash and RAM bytes of the last accepted build, see tools/size_report.py\n")
+        f.write("# name flash ram: total, module or module:function\n")
+        for name in sorted(values, key=lambda n: (n != "total", ":" in n, n)):
+            f.write("%-48s %6d %6d\n" % (name, values[name][0], values[name][1]))
+
+
+def delta(value, baseline, name, index):
+    if baseline is None or name not in baseline:
+        return ""
+    difference = value - baseline[name][index]
+    return "%+d" % difference if difference else ""
+
+
+def report(usage, budget, baseline):
+    def percent(value, limit):
+        return " (%.1f%% of %d)" % (100.0 * value / limit, limit) if limit else ""
+
+    total_budget = budget.get("total", [0, 0]) if budget else [0, 0]
+    print("Flash: %d bytes%s %s" % (usage.flash, percent(usage.flash, total_budget[0]),
+                                    delta(usage.flash, baseline, "total", 0)))
+    print("RAM:   %d bytes%s %s" % (usage.ram, percent(usage.ram, total_budget[1]),
+                                    delta(usage.ram, baseline, "total", 1)))
+    print("Stack: %d bytes" % usage.stack)
+    print("")
+
+    print("%-24s %8s %8s %8s %8s" % ("Module", "Flash", "delta", "RAM", "delta"))
+    for name, (flash, ram) in sorted(usage.modules.items(), key=lambda item: -item[1][0]):
+        print("%-24s %8d %8s %8d %8s" % (name, flash, delta(flash, baseline, name, 0),
+                                         ram, delta(ram, baseline, name, 1)))
+    print("")
+
+    print("%-48s %8s %8s" % ("Largest functions and constants", "Flash", "delta"))
+    functions = sorted(usage.functions.items(), key=lambda item: -item[1])
+    for name, flash in functions[:FUNCTIONS_SHOWN]:
+        print("%-48s %8d %8s" % (name, flash, delta(flash, baseline, name, 0)))
+
+    if baseline:
+        changed = [(name, flash) for name, flash in functions[FUNCTIONS_SHOWN:] if delta(flash, baseline, name, 0)]
+        for name, flash in changed:
+            print("%-48s %8d %8s" % (name, flash, delta(flash, baseline, name, 0)))
+        removed = [name for name in baseline if ":" in name and name not in usage.functions]
+        for name in sorted(removed):
+            print("%-48s %8s %8s" % (name, "-", "-%d" % baseline[name][0]))
+
+
+def check_budget(usage, budget):
+    """over budget messages, a limit of 0 is no limit"""
+    errors = []
+    values = usage.values()
+    for name, limits in sorted(budget.items()):
+        if name not in values:
+            continue
+        for index, memory in enumerate(("flash", "RAM")):
+            if limits[index] and values[name][index] > limits[index]:
+                errors.append("%s %s: %d bytes, budget is %d" % (name, memory, values[name][index], limits[index]))
+    return errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description="LCD3 firmware flash and RAM usage")
+    parser.add_argument("listings", nargs="*", help="relocated listings (.rst) of the firmware modules")
+    parser.add_argument("-m", "--map", required=True, help="linker map file")
+    parser.add_argument("--budget", help="file with the flash and RAM limits")
+    parser.add_argument("--baseline", help="file with the sizes of a previous build, to show the differences")
+    parser.add_argument("--update-baseline", action="store_true", help="write the current sizes to the baseline")
+    args = parser.parse_args()
+
+    try:
+        areas, symbols = parse_map(args.map)
+        for path in args.listings:
+            symbols += parse_listing(path)
+        usage = Usage(areas, symbols_sizes(areas, symbols))
+
+        if args.update_baseline:
+            if not args.baseline:
+                raise ToolError("--update-baseline needs --baseline")
+            write_baseline(args.baseline, usage)
+            print("baseline written to %s" % args.baseline)
+            return 0
+
+        baseline = None
+        if args.baseline:
+            if os.path.exists(args.baseline):
+                baseline = read_values(args.baseline)
+            else:
+                print("no baseline yet, write it with --update-baseline\n")
+        budget = read_values(args.budget) if args.budget else {}
+
+        report(usage, budget, baseline)
+
+        errors = check_budget(usage, budget)
+        if errors:
+            sys.stderr.write("\nERROR: over the size budget\n%s\n" % "\n".join(errors))
+            return 1
+    except (ToolError, OSError) as error:
+        sys.stderr.write("error: %s\n" % error)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,127 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdint.h>
+#include "stm8s.h"
+#include "stm8s_tim3.h"
+#include "main.h"
+#include "lcd.h"
+#include "trip.h"
+
+// Trip statistics
+//
+// Updated at every received package with the elapsed TIM3 ticks (1.024 ms) since the previous package. The values
+// that must be kept over power cycles (moving time, total time, max speed and energy, together with the trip distance)
+// are on the configuration variables, so they are stored on EEPROM at power off. Only the fractions of a second and of
+// the energy unit are kept here.
+//
+// Energy is in W.s: ADC battery voltage * battery current x5 * TIM3 ticks is energy in units of
+// 0.0863 V * 0.2 A * 1.024 ms = 17.674 uJ, so 1 W.s = 56580 units.
+#define TRIP_TICKS_PER_SECOND       977
+#define TRIP_ENERGY_UNITS_PER_WS    56580
+
+// limit the elapsed time between packages to 0.5 seconds, the same as the battery energy integrator
+#define TRIP_MAX_DELTA_TIME         488
+
+static uint16_t ui16_trip_last_time;
+static uint8_t ui8_trip_first_update = 1;
+static uint16_t ui16_trip_moving_ticks;
+static uint16_t ui16_trip_total_ticks;
+static uint32_t ui32_trip_energy_remainder;
+
+void trip_update (uint16_t ui16_wheel_speed_x10, uint16_t ui16_adc_battery_voltage, uint8_t ui8_battery_current_x5)
+{
+  uint16_t ui16_time;
+  uint16_t ui16_delta_time;
+  struct_configuration_variables *p_configuration_variables;
+
+  ui16_time = TIM3_GetCounter ();
+  ui16_delta_time = ui16_time - ui16_trip_last_time;
+  ui16_trip_last_time = ui16_time;
+
+  // there is no previous package time to count from
+  if (ui8_trip_first_update)
+  {
+    ui8_trip_first_update = 0;
+    return;
+  }
+
+  if (ui16_delta_time > TRIP_MAX_DELTA_TIME) { ui16_delta_time = TRIP_MAX_DELTA_TIME; }
+
+  p_configuration_variables = get_configuration_variables ();
+
+  // total time
+  ui16_trip_total_ticks += ui16_delta_time;
+  if (ui16_trip_total_ticks >= TRIP_TICKS_PER_SECOND)
+  {
+    ui16_trip_total_ticks -= TRIP_TICKS_PER_SECOND;
+    p_configuration_variables->ui32_trip_total_time_seconds++;
+  }
+
+  // moving time, max speed and energy, the average power is the one while moving
+  if (ui16_wheel_speed_x10 > 0)
+  {
+    ui16_trip_moving_ticks += ui16_delta_time;
+    if (ui16_trip_moving_ticks >= TRIP_TICKS_PER_SECOND)
+    {
+      ui16_trip_moving_ticks -= TRIP_TICKS_PER_SECOND;
+      p_configuration_variables->ui32_trip_moving_time_seconds++;
+    }
+
+    if (ui16_wheel_speed_x10 > p_configuration_variables->ui16_trip_max_speed_x10)
+    {
+      p_configuration_variables->ui16_trip_max_speed_x10 = ui16_wheel_speed_x10;
+    }
+
+    ui32_trip_energy_remainder += ((uint32_t) ui16_adc_battery_voltage) * ((uint32_t) ui8_battery_current_x5) * ((uint32_t) ui16_delta_time);
+    if (ui32_trip_energy_remainder >= TRIP_ENERGY_UNITS_PER_WS)
+    {
+      p_configuration_variables->ui32_trip_energy_ws += ui32_trip_energy_remainder / TRIP_ENERGY_UNITS_PER_WS;
+      ui32_trip_energy_remainder %= TRIP_ENERGY_UNITS_PER_WS;
+    }
+  }
+}
+
+void trip_reset (void)
+{
+  struct_configuration_variables *p_configuration_variables;
+  p_configuration_variables = get_configuration_variables ();
+
+  p_configuration_variables->ui16_odometer_distance_x10 = 0;
+  p_configuration_variables->ui32_trip_moving_time_seconds = 0;
+  p_configuration_variables->ui32_trip_total_time_seconds = 0;
+  p_configuration_variables->ui16_trip_max_speed_x10 = 0;
+  p_configuration_variables->ui32_trip_energy_ws = 0;
+
+  ui16_trip_moving_ticks = 0;
+  ui16_trip_total_ticks = 0;
+  ui32_trip_energy_remainder = 0;
+}
+
+uint16_t trip_get_average_speed_x10 (void)
+{
+  struct_configuration_variables *p_configuration_variables;
+  p_configuration_variables = get_configuration_variables ();
+
+  if (p_configuration_variables->ui32_trip_moving_time_seconds == 0) { return 0; }
+
+  // 0.1 km / (seconds / 3600) = km/h x10
+  return (uint16_t) ((((uint32_t) p_configuration_variables->ui16_odometer_distance_x10) * 3600) /
+      p_configuration_variables->ui32_trip_moving_time_seconds);
+}
+
+uint16_t trip_get_average_power (void)
+{
+  struct_configuration_variables *p_configuration_variables;
+  p_configuration_variables = get_configuration_variables ();
+
+  if (p_configuration_variables->ui32_trip_moving_time_seconds == 0) { return 0; }
+
+  // average power while moving
+  return (uint16_t) (p_configuration_variables->ui32_trip_energy_ws / p_configuration_variables->ui32_trip_moving_time_seconds);
+}
@@ -0,0 +1,19 @@
+/*
+ * LCD3 firmware
+ *
+ * Copyright (C) Casainho, 2018.
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#ifndef _TRIP_H_
+#define _TRIP_H_
+
+#include "main.h"
+
+void trip_update (uint16_t ui16_wheel_speed_x10, uint16_t ui16_adc_battery_voltage, uint8_t ui8_battery_current_x5);
+void trip_reset (void);
+uint16_t trip_get_average_speed_x10 (void);
+uint16_t trip_get_average_power (void);
+
+#endif /* _TRIP_H_ */
@@ -14,6 +14,10 @@
 #include "main.h"
 #include "lcd.h"
 #include "utils.h"
+#include "uart.h"
+#include "battery.h"
+#include "odometer.h"
+#include "trip.h"
 
 volatile uint8_t ui8_received_package_flag = 0;
 volatile uint8_t ui8_rx_buffer[22];
@@ -148,6 +152,13 @@ void clock_uart_data (void)
       p_motor_controller_data->ui16_motor_speed_erps = (((uint16_t) ui8_rx_buffer [17]) << 8) + ((uint16_t) ui8_rx_buffer [16]);
       p_motor_controller_data->ui8_foc_angle = ui8_rx_buffer[18];
 
+      // integrate battery energy, state of charge and trip statistics at every package, after the first packages with incorrect ADC battery voltage
+      if (uart_received_first_package ())
+      {
+        battery_update (p_motor_controller_data->ui16_adc_battery_voltage, p_motor_controller_data->ui8_battery_current_x5);
+        trip_update (p_motor_controller_data->ui16_wheel_speed_x10, p_motor_controller_data->ui16_adc_battery_voltage, p_motor_controller_data->ui8_battery_current_x5);
+      }
+
       switch (ui8_slave_comm_package_id)
       {
         case 0:
@@ -174,9 +185,15 @@ void clock_uart_data (void)
           // wheel_speed_sensor_tick_counter
           ui32_wss_tick_temp |= (((uint32_t) ui8_rx_buffer[19]) << 16);
           p_motor_controller_data->ui32_wheel_speed_sensor_tick_counter = ui32_wss_tick_temp;
+
+          // update distance with the new complete tick counter value
+          odometer_update (ui32_wss_tick_temp);
         break;
       }
 
+      // wheel speed estimation, after a possible new tick counter value
+      odometer_speed_update (p_motor_controller_data->ui16_wheel_speed_x10);
+
       // signal that we processed the full package
       ui8_received_package_flag = 0;
 
@@ -301,6 +318,12 @@ void clock_uart_data (void)
   }
 }
 
+// the configurations are sent one per package, starting again from the first one
+void uart_resend_configurations (void)
+{
+  ui8_master_comm_package_id = 0;
+}
+
 uint8_t uart_received_first_package (void)
 {
   return (ui8_uart_received_first_package == 10) ? 1: 0;
@@ -14,6 +14,7 @@
 void uart2_init (void);
 void clock_uart_data (void);
 uint8_t uart_received_first_package (void);
+void uart_resend_configurations (void);
 
 #if __SDCC_REVISION < 9624
 void putchar(char c);